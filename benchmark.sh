@@ -0,0 +1,66 @@
+#!/bin/bash
+#
+# Benchmark harness. Decodes test.dat and a synthetic corpus with all output formats.
+# Used as training run for "make pgo" and to compare two builds:
+#
+#   ./benchmark.sh vc830.x86_64                     # Time one build
+#   ./benchmark.sh vc830.x86_64 vc830.x86_64-pgo    # Compare two builds and report the speedup
+#
+
+if [ $# -lt 1 ] ; then
+	echo "Usage: $0 <vc830 executable> [<vc830 executable to compare>]"
+	exit 1
+fi
+
+# Number of frames in the synthetic corpus and how often test.dat is replayed:
+FRAMES=${FRAMES:-50000}
+REPEAT=${REPEAT:-100}
+
+WORK=`mktemp -d`
+trap "rm -rf $WORK" EXIT
+
+# Real captured data, repeated to get measurable times
+for ((n = 0; n < $REPEAT; n++)); do cat test.dat; done > $WORK/test.dat
+
+# Synthetic FS9922 pakets over all units, prefixes, ranges and modes (see decodeFS9922Paket())
+LC_ALL=C awk -v frames=$FRAMES 'BEGIN {
+	srand(42);
+	split("49 41 21 19 17 51 33", sb1);	# AUTO/DC/AC/REL/HOLD/BPN combinations
+	split("0 4 32 16 128", sb2);		# -, Bat, MAX, MIN, Diode
+	split("0 64 128 32 16 8 2", sb3);	# -, m, µ, k, M, Beep, %
+	split("128 64 32 8 4 2 1", sb4);	# V, A, Ω, Hz, F, °C, °F
+	for (i = 0; i < frames; i++) {
+		printf "%c", rand() < 0.5 ? 43 : 45;
+		if (rand() < 0.05) printf "?0:?";
+		else printf "%04d", int(rand() * 10000);
+		printf " %c", 48 + int(rand() * 5);
+		printf "%c%c%c%c", sb1[1 + int(rand() * 7)], sb2[1 + int(rand() * 5)], sb3[1 + int(rand() * 7)], sb4[1 + int(rand() * 7)];
+		printf "%c\r\n", int(rand() * 61) + (rand() < 0.5 ? 128 : 0);
+	}
+}' > $WORK/synthetic.dat
+
+# Runs all output formats over both corpora, prints the elapsed seconds
+run() {
+	local exe=$1
+	case $exe in */*) ;; *) exe=./$exe ;; esac
+	local start=`date +%s.%N`
+
+	for corpus in $WORK/test.dat $WORK/synthetic.dat; do
+		for format in human si json keyvalue speech cbor msgpack; do
+			$exe -f $format -t iso $corpus > /dev/null || exit 1
+		done
+		$exe -a 100 -f json $corpus > /dev/null || exit 1
+	done
+
+	local end=`date +%s.%N`
+	echo "$start $end" | awk '{ printf "%.3f\n", $2 - $1 }'
+}
+
+t1=`run $1` || exit 1
+echo "$1: $t1 s"
+
+if [ $# -ge 2 ] ; then
+	t2=`run $2` || exit 1
+	echo "$2: $t2 s"
+	echo "$t1 $t2" | awk '{ printf "speedup: %.2fx\n", $1 / $2 }'
+fi
@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+#
+# Scaling benchmark. Simulates N meters on pseudo terminals, which send the pakets of test.dat
+# with the real rate of the VC-830 (2 pakets per second), and runs vc830 on all of them:
+#
+#   ./benchmark_scaling.py vc830.x86_64                                  # 1, 10, 100, 500 meters
+#   ./benchmark_scaling.py -n 1,100 -f human,cbor -d 20 vc830.x86_64     # or "make benchmark-scaling"
+#
+# For each meter count and output format, one JSON result line is written to stdout:
+#   cpuPerMeter           CPU time of vc830 per meter in % of one core
+#   latencyP50/P99Ms      Time from the last byte of a paket until its output is read from vc830
+#   readsPerFrame         read() calls of vc830 per paket (/proc/<pid>/io)
+#   writesPerFrame        write() calls of vc830 per paket
+#   wakeupsPerFrame       Voluntary context switches per paket, each is one wait in poll()
+#   maxRssKb              Max. resident set size of vc830
+# The latencies are not measured for the speech format, it has no output per sample.
+#
+import argparse
+import json
+import os
+import pty
+import resource
+import subprocess
+import sys
+import threading
+import time
+import tty
+
+PAKET_LEN = 14
+
+
+# --------------------------------------------------------------------------------------------------------------
+
+#
+# Splits the output of vc830 into records and returns the device index for each complete record.
+# With one meter there is no device field, all records belong to meter 0.
+#
+class RecordParser:
+    def __init__(self, fmt, meters):
+        self.fmt = fmt
+        self.meters = meters
+        self.index = {"m%d" % m: m for m in range(meters)}
+        self.buf = b""
+        self.device = 0
+
+    def feed(self, data):
+        self.buf += data
+        if self.fmt in ("cbor", "msgpack"):
+            return self.binaryRecords()
+        return self.textRecords()
+
+    def textRecords(self):
+        done = []
+        *lines, self.buf = self.buf.split(b"\n")
+        for line in lines:
+            text = line.decode("utf-8", "replace")
+            if self.fmt in ("human", "si"):
+                done.append(self.index[text.split("\t")[0]] if self.meters > 1 else 0)
+            elif self.fmt == "json":
+                if text.startswith('\t"device": '):
+                    self.device = self.index[text.split('"')[3]]
+                elif text == "}":
+                    done.append(self.device)
+            elif self.fmt == "keyvalue":
+                if text.startswith("device="):
+                    self.device = self.index[text[7:]]
+                elif text.startswith("formatedSiValue="):
+                    done.append(self.device)
+        return done
+
+    def binaryRecords(self):
+        done = []
+        decode = decodeCbor if self.fmt == "cbor" else decodeMsgpack
+        while self.buf:
+            try:
+                record, used = decode(self.buf, 0)
+            except IndexError:  # Incomplete record
+                break
+            self.buf = self.buf[used:]
+            done.append(self.index[record["device"]] if self.meters > 1 else 0)
+        return done
+
+
+# Minimal decoders for the maps written by vc830 (string keys). Raise IndexError if data is missing.
+def decodeCbor(b, i):
+    head = b[i]
+    major, arg = head >> 5, head & 31
+    i += 1
+    if major == 7:
+        size = {20: 0, 21: 0, 22: 0, 26: 4, 27: 8}[arg]
+        if i + size > len(b):
+            raise IndexError
+        return {20: False, 21: True, 22: None}.get(arg), i + size
+    if arg >= 24:
+        size = {24: 1, 25: 2, 26: 4, 27: 8}[arg]
+        if i + size > len(b):
+            raise IndexError
+        arg = int.from_bytes(b[i : i + size], "big")
+        i += size
+    if major == 3:
+        if i + arg > len(b):
+            raise IndexError
+        return b[i : i + arg].decode(), i + arg
+    if major == 5:
+        result = {}
+        for _ in range(arg):
+            key, i = decodeCbor(b, i)
+            result[key], i = decodeCbor(b, i)
+        return result, i
+    if major == 6:
+        return decodeCbor(b, i)
+    return arg, i
+
+
+def decodeMsgpack(b, i):
+    t = b[i]
+    i += 1
+    if 0x80 <= t <= 0x8F or t == 0xDE:
+        count = t & 15
+        if t == 0xDE:
+            count = int.from_bytes(b[i : i + 2], "big")
+            i += 2
+        result = {}
+        for _ in range(count):
+            key, i = decodeMsgpack(b, i)
+            result[key], i = decodeMsgpack(b, i)
+        return result, i
+    if 0xA0 <= t <= 0xBF or t == 0xD9:
+        size = t & 31
+        if t == 0xD9:
+            size = b[i]
+            i += 1
+        if i + size > len(b):
+            raise IndexError
+        return b[i : i + size].decode(), i + size
+    size = {0xCA: 4, 0xCB: 8, 0xCC: 1, 0xCD: 2, 0xCE: 4, 0xCF: 8, 0xD0: 1, 0xD1: 2, 0xD2: 4, 0xD3: 8, 0xD7: 9}.get(t, 0)
+    if i + size > len(b):
+        raise IndexError
+    return None, i + size
+
+
+# --------------------------------------------------------------------------------------------------------------
+
+
+def procValues(pid, name, keys):
+    values = {}
+    try:
+        with open("/proc/%d/%s" % (pid, name)) as f:
+            for line in f:
+                key, _, value = line.partition(":")
+                if key in keys:
+                    values[key] = int(value.split()[0])
+    except OSError:
+        pass
+    return values
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+# Counters of vc830 from /proc: CPU seconds, read() and write() calls, voluntary context switches
+def counters(pid):
+    schedstat = open("/proc/%d/schedstat" % pid).read().split()  # Nanoseconds on the CPU
+    io = procValues(pid, "io", ("syscr", "syscw"))
+    status = procValues(pid, "status", ("voluntary_ctxt_switches",))
+    return {
+        "cpu": int(schedstat[0]) / 1e9,
+        "reads": io.get("syscr", 0),
+        "writes": io.get("syscw", 0),
+        "wakeups": status.get("voluntary_ctxt_switches", 0),
+    }
+
+
+def run(exe, meters, fmt, duration, rate, pakets):
+    masters, slaves, devices = [], [], []
+    for m in range(meters):
+        master, slave = pty.openpty()
+        tty.setraw(slave)
+        masters.append(master)
+        slaves.append(slave)
+        devices.append("m%d=%s" % (m, os.ttyname(slave)))
+
+    proc = subprocess.Popen([exe, "-f", fmt] + devices, stdout=subprocess.PIPE)
+    time.sleep(0.5 + meters * 0.002)  # All devices are opened
+
+    sent = [[] for _ in range(meters)]  # Send times of the pakets not yet output, per meter
+    latencies = []
+    outputs = [0]
+    parser = RecordParser(fmt, meters)
+
+    def reader():
+        fd = proc.stdout.fileno()
+        while True:
+            data = os.read(fd, 65536)
+            if not data:
+                return
+            now = time.monotonic()
+            for m in parser.feed(data):
+                outputs[0] += 1
+                if sent[m]:
+                    latencies.append(now - sent[m].pop(0))
+
+    threading.Thread(target=reader, daemon=True).start()
+
+    # The meters are spread over the paket period, like free running instruments
+    before = counters(proc.pid)
+    period = 1.0 / rate
+    start = time.monotonic()
+    frames = 0
+    while time.monotonic() - start < duration:
+        m = frames % meters
+        delay = start + (frames // meters) * period + m * period / meters - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        if fmt != "speech":
+            sent[m].append(time.monotonic())  # Before the write, the output may be read before write() returns
+        os.write(masters[m], pakets[(frames // meters) % len(pakets)])
+        frames += 1
+    elapsed = time.monotonic() - start
+    time.sleep(0.5)  # Drain
+
+    after = counters(proc.pid)
+    maxRssKb = procValues(proc.pid, "status", ("VmHWM",)).get("VmHWM")
+
+    proc.kill()
+    proc.wait()
+    for fd in masters + slaves:
+        os.close(fd)
+
+    def perFrame(key):
+        return round((after[key] - before[key]) / frames, 3)
+
+    def ms(p):
+        value = percentile(latencies, p)
+        return None if value is None else round(value * 1000, 3)
+
+    return {
+        "meters": meters,
+        "format": fmt,
+        "seconds": round(elapsed, 3),
+        "frames": frames,
+        "outputs": outputs[0],
+        "cpuPerMeter": round((after["cpu"] - before["cpu"]) / elapsed / meters * 100, 4),
+        "latencyP50Ms": ms(50),
+        "latencyP99Ms": ms(99),
+        "readsPerFrame": perFrame("reads"),
+        "writesPerFrame": perFrame("writes"),
+        "wakeupsPerFrame": perFrame("wakeups"),
+        "maxRssKb": maxRssKb,
+    }
+
+
+# --------------------------------------------------------------------------------------------------------------
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Scaling benchmark with simulated meters")
+    parser.add_argument("exe", help="vc830 executable")
+    parser.add_argument("-n", "--meters", default="1,10,100,500", help="Meter counts (default 1,10,100,500)")
+    parser.add_argument("-f", "--formats", default="human,si,json,keyvalue,speech,cbor,msgpack", help="Output formats")
+    parser.add_argument("-d", "--duration", type=float, default=10, help="Seconds per run (default 10)")
+    parser.add_argument("-r", "--rate", type=float, default=2, help="Pakets per second and meter (default 2)")
+    parser.add_argument("--data", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "test.dat"))
+    args = parser.parse_args()
+
+    exe = os.path.abspath(args.exe)
+    data = open(args.data, "rb").read()
+    pakets = [data[i : i + PAKET_LEN] for i in range(0, len(data) - PAKET_LEN + 1, PAKET_LEN)]
+
+    # Each meter needs a pty master here and the slave in vc830
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    for meters in [int(n) for n in args.meters.split(",")]:
+        for fmt in args.formats.split(","):
+            result = run(exe, meters, fmt, args.duration, args.rate, pakets)
+            print(json.dumps(result), flush=True)
+            print(
+                "%4d meters %-8s  cpu/meter %.3f%%  p50 %s ms  p99 %s ms  reads/frame %.2f  rss %s kB"
+                % (meters, fmt, result["cpuPerMeter"], result["latencyP50Ms"], result["latencyP99Ms"],
+                   result["readsPerFrame"], result["maxRssKb"]),
+                file=sys.stderr,
+            )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,25 @@
+#
+# Python extension module for the VC-830 decoder.
+#
+#   python3 setup.py build_ext --inplace     (or "make python" in the top directory)
+#
+import os
+
+from setuptools import Extension, setup
+
+top = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+setup(
+    name="vc830",
+    version="1.1.0",
+    description="Voltcraft VC-830 (FS9922-DMM4) decoder",
+    ext_modules=[
+        Extension(
+            "vc830",
+            sources=["vc830module.c"],
+            include_dirs=[top],
+            depends=[os.path.join(top, "vc830.h")],
+            extra_compile_args=["-O3"],
+        )
+    ],
+)
@@ -0,0 +1,313 @@
+/*
+ * =============================================================================
+ *             (c) by Thomas Welsch / 2021 under the MIT License
+ * =============================================================================
+ *
+ * Python extension module for the VC-830 decoder (vc830.h).
+ *
+ * Reads captured data or a live device and returns the decoded samples as columns.
+ * The columns support the buffer protocol, so they can be used without copy, e.g.
+ * with numpy.asarray() or memoryview():
+ *
+ *   import vc830, numpy
+ *   data  = vc830.read("test.dat")
+ *   value = numpy.asarray(data["value"])          # float64, SI base unit
+ *   auto  = numpy.asarray(data["status"]) & vc830.STATUS_AUTO
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <sys/stat.h>
+
+#include "vc830.h"
+
+#define READ_CHUNK_FRAMES 4096  // Frames per read() for capture files
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// A column of decoded samples, one dimensional, exported with the buffer protocol.
+//
+typedef struct {
+    PyObject_HEAD
+    char       *data;
+    Py_ssize_t  length;
+    Py_ssize_t  itemSize;
+    const char *format;  // struct module format of one item
+} ColumnObject;
+
+static void Column_dealloc(ColumnObject *self)
+{
+    PyMem_RawFree(self->data);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Column_getbuffer(ColumnObject *self, Py_buffer *view, int flags)
+{
+    view->obj        = (PyObject *)self;
+    view->buf        = self->data;
+    view->len        = self->length * self->itemSize;
+    view->readonly   = 0;
+    view->itemsize   = self->itemSize;
+    view->format     = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+    view->ndim       = 1;
+    view->shape      = (flags & PyBUF_ND) ? &self->length : NULL;
+    view->strides    = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->itemSize : NULL;
+    view->suboffsets = NULL;
+    view->internal   = NULL;
+
+    Py_INCREF(self);
+    return 0;
+}
+
+static Py_ssize_t Column_length(ColumnObject *self) { return self->length; }
+
+static PyObject *Column_repr(ColumnObject *self)
+{
+    return PyUnicode_FromFormat("<vc830.Column format='%s' length=%zd>", self->format, self->length);
+}
+
+static PyBufferProcs Column_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Column_getbuffer,
+};
+
+static PySequenceMethods Column_as_sequence = {
+    .sq_length = (lenfunc)Column_length,
+};
+
+static PyTypeObject ColumnType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "vc830.Column",
+    .tp_doc         = "Column of decoded samples, supports the buffer protocol.",
+    .tp_basicsize   = sizeof(ColumnObject),
+    .tp_flags       = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc     = (destructor)Column_dealloc,
+    .tp_repr        = (reprfunc)Column_repr,
+    .tp_as_buffer   = &Column_as_buffer,
+    .tp_as_sequence = &Column_as_sequence,
+};
+
+// Takes ownership of data
+static PyObject *newColumn(void *data, Py_ssize_t length, Py_ssize_t itemSize, const char *format)
+{
+    ColumnObject *c = PyObject_New(ColumnObject, &ColumnType);
+    if (c == NULL) {
+        PyMem_RawFree(data);
+        return NULL;
+    }
+    c->data     = data;
+    c->length   = length;
+    c->itemSize = itemSize;
+    c->format   = format;
+    return (PyObject *)c;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+struct Columns {
+    Py_ssize_t capacity;
+    Py_ssize_t length;
+    long       errors;  // Pakets rejected by decodeFS9922Paket()
+    double    *time;
+    double    *value;
+    uint32_t  *status;
+    uint8_t   *unit;
+    uint8_t   *overflow;
+};
+
+static bool allocColumns(struct Columns *c, Py_ssize_t capacity)
+{
+    memset(c, 0, sizeof(*c));
+    c->capacity = capacity;
+
+    if (capacity == 0) capacity = 1;  // No zero size allocations
+    c->time     = PyMem_RawMalloc(capacity * sizeof(double));
+    c->value    = PyMem_RawMalloc(capacity * sizeof(double));
+    c->status   = PyMem_RawMalloc(capacity * sizeof(uint32_t));
+    c->unit     = PyMem_RawMalloc(capacity * sizeof(uint8_t));
+    c->overflow = PyMem_RawMalloc(capacity * sizeof(uint8_t));
+
+    return c->time && c->value && c->status && c->unit && c->overflow;
+}
+
+static void freeColumns(struct Columns *c)
+{
+    PyMem_RawFree(c->time);
+    PyMem_RawFree(c->value);
+    PyMem_RawFree(c->status);
+    PyMem_RawFree(c->unit);
+    PyMem_RawFree(c->overflow);
+    memset(c, 0, sizeof(*c));
+}
+
+static void addPaket(struct Columns *c, byte buf[])
+{
+    struct Vc830 vc830Data;
+
+    if (decodeFS9922Paket(buf, 0, &vc830Data) != 0) {  // Numeric fields only
+        c->errors++;
+        return;
+    }
+
+    Py_ssize_t i   = c->length++;
+    c->time[i]     = vc830Data.receivedAt.tv_sec + vc830Data.receivedAt.tv_usec / 1000000.0;
+    c->value[i]    = vc830Data.siValue;
+    c->status[i]   = vc830Data.status;
+    c->unit[i]     = vc830Data.status & STATUS_UNITS;
+    c->overflow[i] = vc830Data.overflow;
+}
+
+// Same framing as read14BytesPaket() for files: consecutive 14 byte pakets. Return 0 or errno.
+static int readCaptureFile(int fd, struct Columns *c)
+{
+    const int size = 14 * READ_CHUNK_FRAMES;
+    byte     *buf  = PyMem_RawMalloc(size);
+    int       have = 0;
+
+    if (buf == NULL) return ENOMEM;
+
+    while (c->length + c->errors < c->capacity) {
+        ssize_t l = read(fd, buf + have, size - have);
+        if (l < 0) {
+            PyMem_RawFree(buf);
+            return errno;
+        }
+        if (l == 0) break;
+        have += l;
+
+        int n = 0;
+        for (; n + 14 <= have && c->length + c->errors < c->capacity; n += 14) addPaket(c, buf + n);
+        memmove(buf, buf + n, have - n);
+        have -= n;
+    }
+    PyMem_RawFree(buf);
+    return 0;
+}
+
+static int readDevice(int fd, struct Columns *c)
+{
+    byte buf[BUFFER_LEN];
+
+    while (c->length < c->capacity) {
+        int ret = read14BytesPaket(fd, buf);
+        if (ret == END_OF_CAPTURE_FILE) break;
+        if (ret != 0) return EIO;
+        addPaket(c, buf);
+    }
+    return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static PyObject *vc830_read(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = { "path", "count", NULL };
+    const char  *path;
+    Py_ssize_t   count = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|n:read", keywords, &path, &count)) return NULL;
+
+    struct stat st;
+    if (stat(path, &st) != 0) return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    bool isFile = S_ISREG(st.st_mode);
+
+    int fd = isFile ? open(path, O_RDONLY) : openDevice(path);
+    if (fd < 0) return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+
+    if (count < 0) {
+        if (!isFile) {
+            close(fd);
+            PyErr_SetString(PyExc_ValueError, "count is needed for devices");
+            return NULL;
+        }
+        count = st.st_size / 14;
+    }
+
+    struct Columns c;
+    if (!allocColumns(&c, count)) {
+        freeColumns(&c);
+        close(fd);
+        return PyErr_NoMemory();
+    }
+
+    int err;
+    Py_BEGIN_ALLOW_THREADS;
+    err = isFile ? readCaptureFile(fd, &c) : readDevice(fd, &c);
+    close(fd);
+    Py_END_ALLOW_THREADS;
+
+    if (err) {
+        freeColumns(&c);
+        errno = err;
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+
+    // newColumn() takes the buffer, or frees it on failure. After a failure the columns made so far and
+    // the buffers not wrapped yet are freed.
+    void       *data[]     = { c.time, c.value, c.status, c.unit, c.overflow };
+    Py_ssize_t  itemSize[] = { sizeof(double), sizeof(double), sizeof(uint32_t), sizeof(uint8_t), sizeof(uint8_t) };
+    const char *format[]   = { "d", "d", "I", "B", "?" };
+    PyObject   *columns[5];
+
+    for (int i = 0; i < 5; i++) {
+        columns[i] = newColumn(data[i], c.length, itemSize[i], format[i]);
+        if (columns[i] != NULL) continue;
+
+        for (int k = 0; k < i; k++) Py_DECREF(columns[k]);
+        for (int k = i + 1; k < 5; k++) PyMem_RawFree(data[k]);
+        return NULL;
+    }
+
+    return Py_BuildValue("{s:N,s:N,s:N,s:N,s:N,s:l}", "time", columns[0], "value", columns[1], "status", columns[2],
+                         "unit", columns[3], "overflow", columns[4], "errors", c.errors);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static PyMethodDef vc830Methods[] = {
+    { "read", (PyCFunction)(void (*)(void))vc830_read, METH_VARARGS | METH_KEYWORDS,
+      "read(path, count=-1) -> dict\n\n"
+      "Reads and decodes a capture file (all pakets if count < 0) or count samples from a device.\n"
+      "Returns the columns time (receive time, float64), value (SI base unit, float64), status\n"
+      "(SB1..SB4, uint32, see STATUS_xxx), unit (SB4, uint8, see UNITS), overflow (bool) and the\n"
+      "number of rejected pakets as errors." },
+
+    { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef vc830Module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name    = "vc830",
+    .m_doc     = "Voltcraft VC-830 (FS9922-DMM4) decoder.",
+    .m_size    = -1,
+    .m_methods = vc830Methods,
+};
+
+PyMODINIT_FUNC PyInit_vc830(void)
+{
+    if (PyType_Ready(&ColumnType) < 0) return NULL;
+
+    PyObject *m = PyModule_Create(&vc830Module);
+    if (m == NULL) return NULL;
+
+    Py_INCREF(&ColumnType);
+    PyModule_AddObject(m, "Column", (PyObject *)&ColumnType);
+
+    PyModule_AddIntConstant(m, "STATUS_AUTO", STATUS_AUTO);
+    PyModule_AddIntConstant(m, "STATUS_DC", STATUS_DC);
+    PyModule_AddIntConstant(m, "STATUS_AC", STATUS_AC);
+    PyModule_AddIntConstant(m, "STATUS_REL", STATUS_REL);
+    PyModule_AddIntConstant(m, "STATUS_HOLD", STATUS_HOLD);
+    PyModule_AddIntConstant(m, "STATUS_MAX", STATUS_MAX);
+    PyModule_AddIntConstant(m, "STATUS_MIN", STATUS_MIN);
+    PyModule_AddIntConstant(m, "STATUS_BAT", STATUS_BAT);
+    PyModule_AddIntConstant(m, "STATUS_BEEP", STATUS_BEEP);
+    PyModule_AddIntConstant(m, "STATUS_DIODE", STATUS_DIODE);
+
+    // Unit column values, see SB4 in decodeFS9922Paket()
+    PyModule_AddObject(m, "UNITS", Py_BuildValue("{i:s,i:s,i:s,i:s,i:s,i:s,i:s,i:s}",
+                                                 0x80, "V", 0x40, "A", 0x20, "Ω", 0x10, "hFE",
+                                                 0x08, "Hz", 0x04, "F", 0x02, "°C", 0x01, "°F"));
+    return m;
+}
@@ -4,7 +4,7 @@
  * =============================================================================
  *
  * This file implemnts a Voltcraft VC-830 serial protocol decoder.
- * Based on datasheet FS9922-DMM4-DS-15_EN.pdf.
+ * Based on datasheet FS9922-DMM4-DS-15_EN.pdf. The decoder itself is in vc830.h.
  *
  * CLANG Formater style:
  * { BasedOnStyle: Google, IndentWidth: 4, ColumnLimit: 0, AlignConsecutiveAssignments: true, AlignConsecutiveMacros: true, AlignConsecutiveDeclarations: true, AlignOperands: true, AllowShortBlocksOnASingleLine: true, AllowShortIfStatementsOnASingleLine: true, AllowShortLoopsOnASingleLine: true, KeepEmptyLinesAtTheStartOfBlocks: true, BreakBeforeBraces: Stroustrup }
@@ -12,49 +12,154 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <limits.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include "vc830.h"
+
+#if defined(__linux__)
+#include <linux/serial.h>  // TIOCGICOUNT counters
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#if defined(__linux__) && !defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
 // --------------------------------------------------------------------------------------------------------------
 
 #define VERSION "1.1.0"
 
-#define BUFFER_LEN          100     // Used for all kind of static allocations...
-#define END_OF_CAPTURE_FILE 142857  // EOF of test file reached
+// Compile time limits (and BUFFER_LEN in vc830.h). All buffers are sized statically from them,
+// there is no dynamic allocation. They can be changed with -D, see the "embedded" target in the Makefile.
+#ifndef BATCH_LEN
+#define BATCH_LEN 1024  // Samples per aggregation batch
+#endif
+#ifndef RECORD_MAX_FIELDS
+#define RECORD_MAX_FIELDS 32  // Max. number of fields in a struct Record
+#endif
+#ifndef STDOUT_BUFFER_LEN
+#define STDOUT_BUFFER_LEN 4096  // Static stdio buffer for the outputs
+#endif
+#ifndef BINARY_RECORD_LEN
+#define BINARY_RECORD_LEN 4096  // Max. size of one encoded cbor/msgpack record
+#endif
+#ifndef MAX_DEVICES
+#define MAX_DEVICES 512  // Max. number of devices on the command line
+#endif
+#ifndef MAX_CLIENTS
+#define MAX_CLIENTS 256  // Max. number of clients connected to "-l port"
+#endif
+#ifndef SAMPLE_BUFFER_LEN
+#define SAMPLE_BUFFER_LEN 8192  // One rendered sample for the clients
+#endif
+#ifndef RECORDER_LEN
+#define RECORDER_LEN 1024  // Flight recorder bytes per device, about 35 seconds
+#endif
+#define RECORDER_BURST_ERRORS      3   // Decode errors within RECORDER_BURST_SEC which trigger a dump
+#define RECORDER_BURST_SEC         10
+#define RECORDER_DUMP_INTERVAL_SEC 60  // Min. time between two automatic dumps of a device
+#define RECONNECT_MAX_SEC          30  // Max. delay between two connects of a network device
+#ifndef DEVICE_MAX_ADDRS
+#define DEVICE_MAX_ADDRS 4  // Resolved addresses per network device
+#endif
+#ifndef RELAY_QUEUE_LEN
+#define RELAY_QUEUE_LEN 1024  // Samples of relay:// streams waiting for the merge by time
+#endif
+#define RELAY_DELAY_MSEC 500  // Time a relayed sample waits for older samples of the other streams
+#ifndef MAX_GROUPS
+#define MAX_GROUPS 16  // Max. number of "-g" fusion groups
+#endif
+#define GROUP_MAX_MEMBERS     8
+#define FUSION_WINDOW_MSEC    700  // A fusion round waits this long for the samples of all members
+#define FUSION_DROPOUT_ROUNDS 3    // Rounds without a sample, after which a member is not waited for
+#define TREND_BUCKETS         32   // Time buckets of the "-r" regression window
+#define STATS_GAP_SEC         2    // Longer times between two samples are gaps, not time weighted
+#ifndef CAL_MAX_STEPS
+#define CAL_MAX_STEPS 256  // Max. number of setpoints in a "-s" schedule
+#endif
+#define CAL_MAX_RANGES        16    // Ranges per device in the calibration report
+#define CAL_STABLE_SAMPLES    4     // A reading is stable if so many samples are within CAL_STABLE_DIGITS
+#define CAL_STABLE_DIGITS     3
+#define CAL_CAPTURE_PERCENT   10    // A stable reading belongs to the setpoint if within this % plus digits
+#define CAL_CAPTURE_DIGITS    20
+#define CAL_TOLERANCE_PERCENT 0.5   // Default tolerance of a setpoint, the DC V accuracy of the VC830
+#define CAL_TOLERANCE_DIGITS  3
+#define RANGE_COUNTS          6000  // Full scale of a range in digits
+#ifndef AUTORANGE_MAX_RANGES
+#define AUTORANGE_MAX_RANGES 8  // Ranges per device in the "-u" report
+#endif
+#define AUTORANGE_GAP_SEC      2    // Longer times between two frames are not counted
+#define AUTORANGE_NEAR_TOP     55   // Bar graph level near the switch to the next range (60)
+#define AUTORANGE_HUNT_PER_MIN 6    // Switches per minute from which a device is hunting
+#define EVENT_DEBOUNCE_FRAMES  2    // "-f events": frames with the same state before it is reported
+#define EVENT_SHORT_OHM        30   // Continuity below is a short
+#define EVENT_SHORT_VOLT       0.1  // Diode forward voltage below is a short
+
+// The embedded profile guarantees at compile time that no heap is used by this file
+#if defined(VC830_EMBEDDED)
+#pragma GCC poison malloc calloc realloc strdup
+#endif
+
+// All outputs are written to this stream: stdout, or sampleStream while a sample is rendered for the clients
+FILE *output = NULL;  // Set by initStaticMemory()
 
-typedef unsigned char byte;
+// Device name of the current sample, only set with more than one device
+const char *sampleDevice = NULL;
 
-#define strequal(s1, s2) (strcmp((s1), (s2)) == 0)
+// Reconstructed absolute value and REL reference of the current sample in the SI base unit, only set
+// with "-b" for REL samples with a known reference
+bool   sampleHasAbsolute = false;
+double sampleAbsolute;
+double sampleReference;
 
-struct Vc830 {
-    struct timeval receivedAt;                   // Time with mills
-    char           rawRisplay[6];                // 0.000
-    char           sign;                         // -/+
-    char           mode[BUFFER_LEN];             // AC/DC/AC HOLD/AC REL...
-    char           unit[BUFFER_LEN];             // A/V...
-    char           prefix[BUFFER_LEN];           // m, µ, K....
-    char           fullUnit[BUFFER_LEN];         // combined units,  mA,V, mV...
-    char           info[BUFFER_LEN];             // Other infos, not fits currently to the other fields
-    int            barGraph;                     // Bar graph level in %, 0..60, above 60 the autorange is switing to the next upper range
-    bool           barGraphIsShown;              // The bar graph is displayed
-    bool           batteryWarning;               // Battery warning is diesplayed
-    bool           autoRangeActive;              // Auto range is active
-    bool           holdActive;                   // Measurement on holdwith hold key
-    bool           deltaActive;                  // Measurement switch to REL/DELTA mode. no absolute value!
-    bool           overflow;                     // Overflow, mostly if autorange is switched off
-    char           value[BUFFER_LEN];            // Formated value
-    char           formatedValue[BUFFER_LEN];    // Formated value with measurement unit
-    char           formatedSiValue[BUFFER_LEN];  // Formated value, normed to SI base unit
-    char           lastSpeechOutput[BUFFER_LEN]; // Last output from speech. Used to avoid repetitions.    
-};
+bool relAbsolute = false;  // "-b"
+
+// With "-e", MIN or MAX of the current sample, else NULL
+const char *sampleExtremum = NULL;
+bool        holdAware      = false;  // "-e"
+
+// Formats an SI value like formatedSiValue
+const char *formatSi(double value, const char *unit)
+{
+    static char text[BUFFER_LEN];
+
+    snprintf(text, sizeof(text), "%f", value);
+    trimZeros(text);
+    strcat(text, " ");
+    strncat(text, unit, sizeof(text) - strlen(text) - 1);
+    return text;
+}
+
+// Raw paket, sequence number and device name of the current sample for the relay output
+const byte   *samplePaket = NULL;
+unsigned long sampleSeq   = 0;
+const char   *sampleName  = NULL;
 
 // --------------------------------------------------------------------------------------------------------------
 
@@ -72,79 +177,34 @@ void showUsageAndExit(const char *message)
 
     fprintf(stderr, "vc830: Reads serial data from a RS232 device for Voltcraft VC830 DMM. (c) 2021 version %s, Thomas Welsch (ttww@gmx.de)\n", VERSION);
 
-    fprintf(stderr, "Usage: vc830 [-f output-format] [-t time-format] [-c count] <tty device where the VC830 is connected>.\n");
-    fprintf(stderr, "              -f   output-format  keyvalue, json, human, si, speech       Default = human\n");
+    fprintf(stderr, "Usage: vc830 [-f output-format] [-t time-format] [-c count] [-a window] [-k keys] [-l port] [-d dir] [-q seconds] <tty device where the VC830 is connected>...\n");
+    fprintf(stderr, "       A device can be named with name=device, the name is used for the outputs and subscriptions.\n");
+    fprintf(stderr, "       Remote meters: tcp://host:port (raw TCP) or rfc2217://host:port (telnet COM port control).\n");
+    fprintf(stderr, "       Other vc830 (-f relay -l port): relay://host:port, the samples are merged by time.\n");
+    fprintf(stderr, "              -f   output-format  keyvalue, json, human, si, speech,      Default = human\n");
+    fprintf(stderr, "                                  cbor, msgpack, relay, events\n");
     fprintf(stderr, "              -t   time-format    iso, local, epochsecms, human, none     Default = none\n");
     fprintf(stderr, "              -c   count          number of samples                       Default = endless\n");
+    fprintf(stderr, "              -a   window[,lvl]   output statistics every window samples  Default = off\n");
+    fprintf(stderr, "              -k   keys           string, int (cbor and msgpack map keys)  Default = string\n");
+    fprintf(stderr, "              -l   port           send samples to subscribed TCP clients  Default = off\n");
+    fprintf(stderr, "              -d   dir            flight recorder dumps on errors/SIGUSR1  Default = off\n");
+    fprintf(stderr, "              -q   seconds        line error detection and report         Default = off\n");
+    fprintf(stderr, "              -g   name=dev,dev   fused value of redundant meters         Default = off\n");
+    fprintf(stderr, "                                  [,median|mean][,tol=x[%%]], repeatable\n");
+    fprintf(stderr, "              -r   seconds[,thr]  trend over seconds, time to threshold   Default = off\n");
+    fprintf(stderr, "              -m   file           markers from stdin and clients, index   Default = off\n");
+    fprintf(stderr, "              -s   schedule       calibration check against setpoints     Default = off\n");
+    fprintf(stderr, "              -b                  absolute values in REL mode             Default = off\n");
+    fprintf(stderr, "              -e                  HOLD intervals, MIN/MAX as extrema      Default = off\n");
+    fprintf(stderr, "              -u   seconds        autorange report: ranges and switches   Default = off\n");
+    fprintf(stderr, "              -h                  this help\n");
 
     exit(-1);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-void setRtsDtr(int fd)
-{
-    int arg = TIOCM_RTS | TIOCM_DTR;
-    ioctl(fd, TIOCMBIS, &arg);
-    arg = TIOCM_RTS;
-    ioctl(fd, TIOCMBIC, &arg);
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
-int openDevice(const char *deviceName)
-{
-    speed_t bdflag =
-        B2400;  // All VC-830 with FS9922-DMM4 chips are using 2400 Baud, 8N1
-
-    static struct termios tty;
-    int                   modelines = 0;
-
-    int fd = open(deviceName, O_RDWR | O_NOCTTY | O_NDELAY);
-
-    if (fd < 0) {
-        perror("open failed");
-        exit(-1);
-    }
-
-    if (isatty(fd)) {
-        tcgetattr(fd, &tty);
-        tty.c_iflag     = IGNBRK | IGNPAR;
-        tty.c_lflag     = 0;
-        tty.c_oflag     = 0;                             // raw output
-        tty.c_cc[VTIME] = 0;                             // no waiting
-        tty.c_cc[VMIN]  = 1;                             // minimum of reading bytes, was 1
-        tty.c_cflag     = CS8 | CREAD | CLOCAL | HUPCL;  // was STD_FLG; 8N1, read, no modem status,
-#ifdef __linux__
-        tty.c_line = 0;
-#endif
-
-        cfsetispeed(&tty, bdflag);  // input
-        cfsetospeed(&tty, bdflag);  // output
-
-        if (tcsetattr(fd, TCSAFLUSH, &tty) == -1) {
-            perror("tcsetattr TCSAFLUSH failed");
-            return (-1);
-        }
-
-        if (ioctl(fd, TIOCEXCL, &modelines) == -1) {  // Put the tty into exclusive mode.
-            perror("ioctl TIOCEXCL failed");
-            return (-1);
-        }
-
-        setRtsDtr(fd);           // DTR/RTS, important for voltage supply to RS232 optical converter
-        tcflush(fd, TCIOFLUSH);  // flush buffers
-    }
-    else {
-        // fprintf(stderr, "The Device %s is not a terminal device, reading captured
-        // data !\n", deviceName);
-    }
-
-    return (fd);
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
 char *to_binary(unsigned char x)
 {
     static char b[9];
@@ -178,250 +238,14 @@ void showBuffer(byte buf[])
 
 // --------------------------------------------------------------------------------------------------------------
 
-void strinsert(char *srcAndDest, int pos, const char *toInsert)
-{
-    char *buf = malloc(strlen(srcAndDest) + strlen(toInsert) + 1);
-
-    strncpy(buf, srcAndDest, pos);
-    buf[pos] = '\0';
-    strcat(buf, toInsert);
-    strcat(buf, srcAndDest + pos);
-    strcpy(srcAndDest, buf);
-    free(buf);
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
-bool checkInfo(byte buf[], int statusByte, int statusBit, const char *info, char *out)
-{
-    if (buf[7 + statusByte - 1] & (1 << statusBit)) {
-        if (out) {
-            if (out[0]) strcat(out, " ");
-            strcat(out, info);
-        }
-        return true;
-    }
-    return false;
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
-void trimZeros(char *s)
-{
-    char *e = strchr(s, '\0');
-    while (e > s) {
-        e--;
-        if (*e != '0') return;
-        if (e > s && *(e - 1) == '.') return;  // keep last zero after point
-        *e = '\0';
-    }
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
-int decodeFS9922Paket(byte buf[], struct Vc830 *vc830Data)
-{
-    // showBuffer(buf);
-
-    memset(vc830Data, 0, sizeof(*vc830Data));
-
-    gettimeofday(&vc830Data->receivedAt, NULL);
-
-    // Check space and CRLF
-    if (buf[5] != 0x20 || buf[12] != 0x0d || buf[13] != 0x0a)
-        return -1;
-
-    // Check sign
-    int sign = 0;
-    if (buf[0] == 0x2b) sign = 1;
-    if (buf[0] == 0x2d) sign = -1;
-
-    if (sign == 0) return -2;
-
-    // Check value/digits
-    char value[6];
-    int  k = -1;
-
-    if (buf[1] == 0x3f && buf[2] == 0x30 && buf[3] == 0x3a && buf[4] == 0x3f) {
-        vc830Data->overflow = true;
-        strcpy(value, "OVF");
-    }
-    else {
-        // Read value
-        for (int i = 0; i < 4; i++) {
-            if (!isdigit(buf[1 + i])) return -3;
-            value[i] = buf[1 + i];
-        }
-        value[4] = '\0';
-
-        // if (buf[6] == 0x30) k = 0;
-        if (buf[6] == 0x31) k = 1;
-        if (buf[6] == 0x32) k = 2;
-        if (buf[6] == 0x33) k = 3;
-        if (buf[6] == 0x34) k = 3;
-
-        // if (buf[6] == 0x34) nk = 1;
-        if (k != -1) strinsert(value, k, ".");
-    }
-
-    // Check status bytes
-    char mode[BUFFER_LEN];
-    char prefix[BUFFER_LEN];
-    char unit[BUFFER_LEN];
-    char info[BUFFER_LEN];
-
-    mode[0]   = '\0';
-    prefix[0] = '\0';
-    unit[0]   = '\0';
-    info[0]   = '\0';
-
-    // Status byte SB1:
-    vc830Data->autoRangeActive = checkInfo(buf, 1, 5, "AUTO", info);
-    checkInfo(buf, 1, 4, "DC", mode);
-    checkInfo(buf, 1, 3, "AC", mode);
-    vc830Data->deltaActive     = checkInfo(buf, 1, 2, "REL", mode);  // Delta
-    vc830Data->holdActive      = checkInfo(buf, 1, 1, "HOLD", mode);
-    vc830Data->barGraphIsShown = checkInfo(buf, 1, 0, "BPN", NULL);  // Bargraph is shown, info not relevant
-
-    // Status byte SB2:
-    checkInfo(buf, 2, 7, "Diode" /*"Z1"*/, info);  // Diode Unit Volt oder sperre
-    checkInfo(buf, 2, 6, "Z2", info);
-    checkInfo(buf, 2, 5, "MAX", info);
-    checkInfo(buf, 2, 4, "MIN", info);
-    checkInfo(buf, 2, 3, "APO", info);
-    vc830Data->batteryWarning = checkInfo(buf, 2, 2, "Bat", info);
-    checkInfo(buf, 2, 1, "n", prefix);
-    checkInfo(buf, 2, 0, "Z3", info);
-
-    // Status byte SB3:
-    checkInfo(buf, 3, 7, "µ", prefix);
-    checkInfo(buf, 3, 6, "m", prefix);
-    checkInfo(buf, 3, 5, "k", prefix);
-    checkInfo(buf, 3, 4, "M", prefix);
-    checkInfo(buf, 3, 3, "Beep", info);  // Durchgangsprüfung BEEPER
-    checkInfo(buf, 3, 2, "Diode", info);
-    checkInfo(buf, 3, 1, "%", prefix);  // Duty for HZ
-    checkInfo(buf, 3, 0, "Z4", info);
-
-    // Status byte SB4:
-    checkInfo(buf, 4, 7, "V", unit);
-    checkInfo(buf, 4, 6, "A", unit);
-    checkInfo(buf, 4, 5, "Ω", unit);
-    checkInfo(buf, 4, 4, "hFE", unit);
-    checkInfo(buf, 4, 3, "Hz", unit);
-    checkInfo(buf, 4, 2, "F", unit);
-    checkInfo(buf, 4, 1, "°C", unit);
-    checkInfo(buf, 4, 0, "°F", unit);
-
-    double multToSi = 1;
-    if (strequal(prefix, "n")) multToSi = 0.000000001;
-    if (strequal(prefix, "µ")) multToSi = 0.000001;
-    if (strequal(prefix, "m")) multToSi = 0.001;
-    if (strequal(prefix, "k")) multToSi = 1000;
-    if (strequal(prefix, "M")) multToSi = 1000000;
-
-    // Bar % (0-60)
-    byte bar = buf[11] & 0x7f;  // Hi-Bit is sign
-
-    // For the none normalized values (comming from the digits) we keep the
-    // resolution. For the SI base unit normalized values, we scrap the trailing
-    // '0', even if the are comming from the display...
-    double vSi = atof(value) * multToSi * sign;
-
-    char vWithUnit[20];
-    char vSiWithUnit[20];
-
-    vWithUnit[0] = '\0';
-    if (sign == -1) strcat(vWithUnit, "-");
-
-    // Strip '0' at the start:
-    char *vz = value;
-    while (*vz == '0' && *(vz + 1) != '.') vz++;
-
-    // Strip "." at the end:
-    char *se = strrchr(vz, '.');
-    if (se && strequal(se, ".0")) *se = '\0';
-
-    strcat(vWithUnit, vz);
-    strcat(vWithUnit, " ");
-    strcat(vWithUnit, prefix);
-    strcat(vWithUnit, unit);
-
-    snprintf(vSiWithUnit, sizeof(vSiWithUnit), "%f", vSi);
-    trimZeros(vSiWithUnit);
-    strcat(vSiWithUnit, " ");
-    strcat(vSiWithUnit, unit);
-
-    if (false)
-        printf("abs value = |%s| --> sign %d k %d  mode |%s| prefix |%s| unit |%s| info |%s| bar = %d | v = %s  vSi = %f (%s)\n",
-               value, sign, k, mode, prefix, unit, info, bar, vWithUnit, vSi, vSiWithUnit);
-
-    // Copy to output structure
-    vc830Data->sign     = sign == 1 ? '+' : '-';
-    vc830Data->barGraph = bar;
-
-    strcpy(vc830Data->rawRisplay, value);
-    strcpy(vc830Data->mode, mode);
-    strcpy(vc830Data->info, info);
-    strcpy(vc830Data->unit, unit);
-    strcpy(vc830Data->prefix, prefix);
-    strcpy(vc830Data->fullUnit, prefix);
-    strcat(vc830Data->fullUnit, unit);
-    strcpy(vc830Data->value, vz);
-    strcpy(vc830Data->formatedValue, vWithUnit);
-    strcpy(vc830Data->formatedSiValue, vSiWithUnit);
-
-    return 0;
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
-int read14BytesPaket(int fd, byte readBuffer[])
-{
-    fd_set         set;
-    struct timeval timeout;
-    int            bufIdx = 0;
-
-    while (1) {
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 100000;
-
-        FD_ZERO(&set);    /* clear the set */
-        FD_SET(fd, &set); /* add our file descriptor to the set */
-
-        int ret = select(fd + 1, &set, NULL, NULL, &timeout);
-        if (ret == -1) {
-            perror("select failed");
-            return -1;
-        }
-
-        if (ret == 0) {  // timeout, reset buffer
-            bufIdx = 0;
-            continue;
-        }
-
-        int l = read(fd, &readBuffer[bufIdx], 1);
-        if (l == 0) {
-            // This happens only if we are reading a file. For normal TTY devices
-            // the above select() returns only if we have data for the read() call.
-            return END_OF_CAPTURE_FILE;
-        }
-        if (l > 0) bufIdx += l;
-
-        if (bufIdx == 14) return 0;
-
-    }  // while (1)
-}
-
-// --------------------------------------------------------------------------------------------------------------
-
 char *getLocalTime(struct timeval t)
 {
     static char ret[64];
+    struct tm   nowtmBuf;
     struct tm * nowtm;
     char        tmbuf[32];
 
-    nowtm = localtime(&t.tv_sec);
+    nowtm = localtime_r(&t.tv_sec, &nowtmBuf);  // localtime() allocates on every call (tzset)
     strftime(tmbuf, sizeof(tmbuf), "%H:%M:%S", nowtm);
 
     snprintf(ret, sizeof(ret), "%s.%03ld", tmbuf, (long)t.tv_usec / 1000);  // tv_usec is int on some platforms
@@ -434,9 +258,10 @@ char *getLocalTime(struct timeval t)
 char *getLocalDateTime(struct timeval t)
 {
     static char ret[64];
+    struct tm   nowtmBuf;
     struct tm * nowtm;
 
-    nowtm = localtime(&t.tv_sec);
+    nowtm = localtime_r(&t.tv_sec, &nowtmBuf);
 
     strftime(ret, sizeof(ret), "%Y-%m-%d %H:%M:%S", nowtm);
 
@@ -448,11 +273,12 @@ char *getLocalDateTime(struct timeval t)
 char *getIso8601Time(struct timeval t)
 {
     static char ret[200];
+    struct tm   nowtmBuf;
     struct tm * nowtm;
     char        tmbuf[64];
     char        tzbuf[64];
 
-    nowtm = localtime(&t.tv_sec);
+    nowtm = localtime_r(&t.tv_sec, &nowtmBuf);
     strftime(tmbuf, sizeof tmbuf, "%Y-%m-%dT%H:%M:%S", nowtm);
     strftime(tzbuf, sizeof tzbuf, "%z", nowtm);
     snprintf(ret, sizeof(ret), "%s.%06ld%s", tmbuf, (long)t.tv_usec, tzbuf);  // tv_usec is int on some platforms
@@ -471,26 +297,152 @@ char *getEpochSecMsTime(struct timeval t)
 
 // --------------------------------------------------------------------------------------------------------------
 
-void outputJsonString(const char *key, const char *value) { fprintf(stdout, "\t\"%s\": \"%s\"", key, value); }
-void outputJsonChar(const char *key, char value) { fprintf(stdout, "\t\"%s\": \"%c\"", key, value); }
-void outputJsonInt(const char *key, int value) { fprintf(stdout, "\t\"%s\": %d", key, value); }
-void outputJsonBool(const char *key, bool value) { fprintf(stdout, "\t\"%s\": %s", key, value ? "true" : "false"); }
-void outputJsonTimestamp(const char *key, struct timeval value) { fprintf(stdout, "\t\"%s\": \"%s\"", key, getIso8601Time(value)); }
-void outputJsonNLSEP() { fprintf(stdout, ",\n"); }
-void outputJsonNL() { fprintf(stdout, "\n"); }
+void outputJsonString(const char *key, const char *value) { fprintf(output, "\t\"%s\": \"%s\"", key, value); }
+void outputJsonChar(const char *key, char value) { fprintf(output, "\t\"%s\": \"%c\"", key, value); }
+void outputJsonInt(const char *key, int value) { fprintf(output, "\t\"%s\": %d", key, value); }
+void outputJsonBool(const char *key, bool value) { fprintf(output, "\t\"%s\": %s", key, value ? "true" : "false"); }
+void outputJsonTimestamp(const char *key, struct timeval value) { fprintf(output, "\t\"%s\": \"%s\"", key, getIso8601Time(value)); }
+void outputJsonNLSEP() { fprintf(output, ",\n"); }
+void outputJsonNL() { fprintf(output, "\n"); }
+
+// --------------------------------------------------------------------------------------------------------------
+
+void outputKvString(const char *key, const char *value) { fprintf(output, "%s=%s\n", key, value); }
+void outputKvChar(const char *key, char value) { fprintf(output, "%s=%c\n", key, value); }
+void outputKvInt(const char *key, int value) { fprintf(output, "%s=%d\n", key, value); }
+void outputKvBool(const char *key, bool value) { fprintf(output, "%s=%s\n", key, value ? "true" : "false"); }
+void outputKvTimestamp(const char *key, struct timeval value) { fprintf(output, "%s=%s\n", key, getIso8601Time(value)); }
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Records are used for all outputs which are not a single decoded sample (e.g. statistics).
+// They are printed in the selected output format.
+//
+#define RECORD_STRING 0
+#define RECORD_INT    1
+#define RECORD_DOUBLE 2
+#define RECORD_BOOL   3
+
+struct RecordField {
+    const char *key;
+    int         type;            // RECORD_xxx
+    char        str[BUFFER_LEN];  // RECORD_STRING
+    double      number;          // RECORD_INT, RECORD_DOUBLE, RECORD_BOOL
+};
+
+struct Record {
+    const char        *type;  // stats, ...
+    struct timeval     timestamp;
+    int                fieldCount;
+    struct RecordField fields[RECORD_MAX_FIELDS];
+};
+
+void recordBegin(struct Record *r, const char *type, struct timeval timestamp)
+{
+    r->type       = type;
+    r->timestamp  = timestamp;
+    r->fieldCount = 0;
+}
+
+struct RecordField *recordAdd(struct Record *r, const char *key, int type)
+{
+    if (r->fieldCount >= RECORD_MAX_FIELDS) exitWithError("Too many record fields");
+
+    struct RecordField *f = &r->fields[r->fieldCount++];
+    f->key                = key;
+    f->type               = type;
+    f->str[0]             = '\0';
+    f->number             = 0;
+    return f;
+}
+
+void recordString(struct Record *r, const char *key, const char *value)
+{
+    snprintf(recordAdd(r, key, RECORD_STRING)->str, BUFFER_LEN, "%s", value);
+}
+
+void recordInt(struct Record *r, const char *key, long value) { recordAdd(r, key, RECORD_INT)->number = value; }
+void recordDouble(struct Record *r, const char *key, double value) { recordAdd(r, key, RECORD_DOUBLE)->number = value; }
+void recordBool(struct Record *r, const char *key, bool value) { recordAdd(r, key, RECORD_BOOL)->number = value; }
+
+// Formats a non string field value into buf
+const char *recordValueText(const struct RecordField *f, char *buf, int len)
+{
+    if (f->type == RECORD_STRING) return f->str;
+    if (f->type == RECORD_INT) snprintf(buf, len, "%ld", (long)f->number);
+    if (f->type == RECORD_DOUBLE) snprintf(buf, len, "%g", f->number);
+    if (f->type == RECORD_BOOL) snprintf(buf, len, "%s", f->number ? "true" : "false");
+    return buf;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showRecordKeyValue(struct Record *r, const char *timeText)
+{
+    char buf[BUFFER_LEN];
+
+    outputKvString("type", r->type);
+    outputKvTimestamp("timestamp", r->timestamp);
+    if (*timeText) outputKvString("timestampFormated", timeText);
+    for (int i = 0; i < r->fieldCount; i++) {
+        outputKvString(r->fields[i].key, recordValueText(&r->fields[i], buf, sizeof(buf)));
+    }
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showRecordJson(struct Record *r, const char *timeText)
+{
+    char buf[BUFFER_LEN];
+
+    fprintf(output, "{\n");
+
+    outputJsonString("type", r->type);
+    outputJsonNLSEP();
+    outputJsonTimestamp("timestamp", r->timestamp);
+    if (*timeText) {
+        outputJsonNLSEP();
+        outputJsonString("timestampFormated", timeText);
+    }
+    for (int i = 0; i < r->fieldCount; i++) {
+        struct RecordField *f = &r->fields[i];
+        outputJsonNLSEP();
+        if (f->type == RECORD_STRING)
+            outputJsonString(f->key, f->str);
+        else
+            fprintf(output, "\t\"%s\": %s", f->key, recordValueText(f, buf, sizeof(buf)));
+    }
+    outputJsonNL();
+
+    fprintf(output, "}\n");
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showRecordHuman(struct Record *r, const char *timeText)
+{
+    char buf[BUFFER_LEN];
+
+    fprintf(output, "%s%s%s", timeText, *timeText ? "\t\t" : "", r->type);
+    for (int i = 0; i < r->fieldCount; i++) {
+        fprintf(output, "%s%s=%s", i == 0 ? "\t\t" : " ", r->fields[i].key, recordValueText(&r->fields[i], buf, sizeof(buf)));
+    }
+    fprintf(output, "\n");
+    return 1;
+}
 
 // --------------------------------------------------------------------------------------------------------------
 
-void outputKvString(const char *key, const char *value) { fprintf(stdout, "%s=%s\n", key, value); }
-void outputKvChar(const char *key, char value) { fprintf(stdout, "%s=%c\n", key, value); }
-void outputKvInt(const char *key, int value) { fprintf(stdout, "%s=%d\n", key, value); }
-void outputKvBool(const char *key, bool value) { fprintf(stdout, "%s=%s\n", key, value ? "true" : "false"); }
-void outputKvTimestamp(const char *key, struct timeval value) { fprintf(stdout, "%s=%s\n", key, getIso8601Time(value)); }
+int showRecordNone(struct Record *r, const char *timeText) { return 0; }
 
 // --------------------------------------------------------------------------------------------------------------
 
-void showDataKeyValue(struct Vc830 *vc830Data, const char *timeText)
+int showDataKeyValue(struct Vc830 *vc830Data, const char *timeText)
 {
+    if (sampleDevice) outputKvString("device", sampleDevice);
     outputKvTimestamp("receivedAt", vc830Data->receivedAt);
     if (*timeText) outputKvString("receivedAtFormated", timeText);
     outputKvChar("sign", vc830Data->sign);
@@ -510,14 +462,24 @@ void showDataKeyValue(struct Vc830 *vc830Data, const char *timeText)
     outputKvString("value", vc830Data->value);
     outputKvString("formatedValue", vc830Data->formatedValue);
     outputKvString("formatedSiValue", vc830Data->formatedSiValue);
+    if (sampleHasAbsolute) {
+        outputKvString("relReference", formatSi(sampleReference, vc830Data->unit));
+        outputKvString("absoluteSiValue", formatSi(sampleAbsolute, vc830Data->unit));
+    }
+    if (sampleExtremum) outputKvString("extremum", sampleExtremum);
+    return 1;
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-void showDataJson(struct Vc830 *vc830Data, const char *timeText)
+int showDataJson(struct Vc830 *vc830Data, const char *timeText)
 {
-    fprintf(stdout, "{\n");
+    fprintf(output, "{\n");
 
+    if (sampleDevice) {
+        outputJsonString("device", sampleDevice);
+        outputJsonNLSEP();
+    }
     outputJsonTimestamp("receivedAt", vc830Data->receivedAt);
     outputJsonNLSEP();
     if (*timeText) {
@@ -557,242 +519,3393 @@ void showDataJson(struct Vc830 *vc830Data, const char *timeText)
     outputJsonString("formatedValue", vc830Data->formatedValue);
     outputJsonNLSEP();
     outputJsonString("formatedSiValue", vc830Data->formatedSiValue);
+    if (sampleHasAbsolute) {
+        outputJsonNLSEP();
+        outputJsonString("relReference", formatSi(sampleReference, vc830Data->unit));
+        outputJsonNLSEP();
+        outputJsonString("absoluteSiValue", formatSi(sampleAbsolute, vc830Data->unit));
+    }
+    if (sampleExtremum) {
+        outputJsonNLSEP();
+        outputJsonString("extremum", sampleExtremum);
+    }
     outputJsonNL();
 
-    fprintf(stdout, "}\n");
+    fprintf(output, "}\n");
+    return 1;
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-void showDataHuman(struct Vc830 *vc830Data, const char *timeText)
+int showDataHuman(struct Vc830 *vc830Data, const char *timeText)
 {
-    fprintf(stdout, "%s%s%s\t\t%s\t%s\n", timeText, *timeText ? "\t\t" : "",
-            vc830Data->formatedValue, vc830Data->mode, vc830Data->info);
+    fprintf(output, "%s%s%s%s%s\t\t%s\t%s", timeText, *timeText ? "\t\t" : "", sampleDevice ? sampleDevice : "",
+            sampleDevice ? "\t\t" : "", vc830Data->formatedValue, vc830Data->mode, vc830Data->info);
+    if (sampleHasAbsolute) fprintf(output, "\tabsolute %s", formatSi(sampleAbsolute, vc830Data->unit));
+    fprintf(output, "\n");
+    return 1;
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-void showDataSi(struct Vc830 *vc830Data, const char *timeText)
+int showDataSi(struct Vc830 *vc830Data, const char *timeText)
 {
-    fprintf(stdout, "%s%s%s\t\t%s\t%s\n", timeText, *timeText ? "\t\t" : "",
-            vc830Data->formatedSiValue, vc830Data->mode, vc830Data->info);
+    fprintf(output, "%s%s%s%s%s\t\t%s\t%s", timeText, *timeText ? "\t\t" : "", sampleDevice ? sampleDevice : "",
+            sampleDevice ? "\t\t" : "", vc830Data->formatedSiValue, vc830Data->mode, vc830Data->info);
+    if (sampleHasAbsolute) fprintf(output, "\tabsolute %s", formatSi(sampleAbsolute, vc830Data->unit));
+    fprintf(output, "\n");
+    return 1;
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
+//
+// Binary outputs (cbor, msgpack). Each sample or record is one self describing map with typed values,
+// it is encoded into binaryBuffer and written with one fwrite(). The keys are encoded once at startup,
+// with "-k int" the index into binaryKeys[] is used as key instead of the name.
+//
+// The binary sample has less fields than the text outputs: the value is a number and the flags are
+// in info and status, so sign, prefix, the flag booleans and the formated values are omitted.
+//
+// All keys as X(KEY_xxx suffix, name). The index is part of the format (-k int), new keys must be added
+// at the end.
 // clang-format off
-const char *textToSpeechData[] = {
-    "Ω",          "Ohm",
-    "V",          "Volt",
-    "A",          "Ampere",
-    "hFE",        "Verstärkungsfaktor",     // differentielle Stromverstärkungsfaktor
-    "Hz",         "Herz",
-    "F",          "Farad",
-    "°F",         "Fahrenheit",
-    "°C",         "Celsius",
+#define BINARY_KEYS(X)                                                                                               \
+    /* Sample */                                                                                                     \
+    X(RECEIVED_AT, "receivedAt") X(RECEIVED_AT_FORMATED, "receivedAtFormated") X(MODE, "mode") X(UNIT, "unit")       \
+    X(FULL_UNIT, "fullUnit") X(INFO, "info") X(BAR_GRAPH, "barGraph") X(OVERFLOW, "overflow")                        \
+    X(RAW_DISPLAY, "rawRisplay") X(VALUE, "value") X(SI_VALUE, "siValue") X(STATUS, "status")                        \
+    /* Record */                                                                                                     \
+    X(TYPE, "type") X(TIMESTAMP, "timestamp") X(TIMESTAMP_FORMATED, "timestampFormated")                             \
+    /* Statistics */                                                                                                 \
+    X(SAMPLES, "samples") X(OVERFLOWS, "overflows") X(MIN, "min") X(MAX, "max") X(MEAN, "mean") X(RMS, "rms")        \
+    X(STDDEV, "stddev") X(DURATION, "duration") X(COUNT_AUTO, "countAuto") X(COUNT_HOLD, "countHold")                \
+    X(COUNT_REL, "countRel") X(COUNT_MIN, "countMin") X(COUNT_MAX, "countMax") X(COUNT_BAT, "countBat")              \
+    /* Line report */                                                                                                \
+    X(DEVICE, "device") X(FRAMES, "frames") X(DECODE_ERRORS, "decodeErrors") X(RESYNCS, "resyncs")                   \
+    X(LINE_ERRORS, "lineErrors") X(RX, "rx") X(FRAME_ERRORS, "frameErrors") X(PARITY_ERRORS, "parityErrors")         \
+    X(OVERRUNS, "overruns") X(BUFFER_OVERRUNS, "bufferOverruns") X(BREAKS, "breaks") X(RECONNECTS, "reconnects")     \
+    X(LOST, "lost")                                                                                                  \
+    /* Fusion */                                                                                                     \
+    X(GROUP, "group") X(METHOD, "method") X(MEMBERS, "members") X(USED, "used") X(OUTLIERS, "outliers")              \
+    X(MISSING, "missing") X(DISAGREEMENT, "disagreement") X(SPREAD, "spread")                                        \
+    /* Trend */                                                                                                      \
+    X(SLOPE, "slope") X(R2, "r2") X(EXP_RATE, "expRate") X(EXP_R2, "expR2") X(THRESHOLD, "threshold")                \
+    X(TIME_TO_THRESHOLD, "timeToThreshold") X(EXP_TIME_TO_THRESHOLD, "expTimeToThreshold")                           \
+    /* Marker */                                                                                                     \
+    X(INDEX, "index") X(SAMPLE, "sample") X(TEXT, "text")                                                            \
+    /* Calibration */                                                                                                \
+    X(STEP, "step") X(SETPOINT, "setpoint") X(RANGE, "range") X(ERROR, "error") X(ERROR_PERCENT, "errorPercent")     \
+    X(LIMIT, "limit") X(PASS, "pass") X(STEPS, "steps") X(PASSED, "passed") X(WORST, "worst")                        \
+    X(MEASURED, "measured")                                                                                          \
+    /* REL, "-b" */                                                                                                  \
+    X(REFERENCE, "reference") X(ABSOLUTE, "absolute")                                                                \
+    /* MIN, MAX, "-e" */                                                                                             \
+    X(EXTREMUM, "extremum")                                                                                          \
+    /* Autorange */                                                                                                  \
+    X(SWITCHES, "switches") X(SWITCHES_PER_MINUTE, "switchesPerMinute") X(LATENCY_MEAN, "latencyMean")               \
+    X(LATENCY_MAX, "latencyMax") X(HUNTING, "hunting") X(SECONDS, "seconds") X(SHARE, "share")                       \
+    X(NEAR_TOP, "nearTop")                                                                                           \
+    /* Statistics */                                                                                                 \
+    X(TW_MEAN, "twMean") X(TW_RMS, "twRms") X(TW_DURATION, "twDuration") X(LEVEL, "level") X(DUTY, "duty")           \
+    X(GAPS, "gaps")
+// clang-format on
 
-    "n",         "nano",
-    "µ",         "micro",
-    "m",         "milli",
-    "k",         "kilo",
-    "M",         "mega",
-    "%",         "Prozent",
+#define BINARY_KEY_NAME(key, name) name,
+#define BINARY_KEY_ENUM(key, name) KEY_##key,
 
-    "OVF",        "Überlauf",
-    "AUTO",       "Automatische Bereichswahl",
-    "DC",         "Gleichspannung",
-    "DC REL",     "Gleichspannung, relative Anzeige",
-    "DC HOLD",    "Gleichspannung, Anzeige gestoppt",
-    "AC",         "Wechselspannung",
-    "AC REL",     "Wechselspannung, relative Anzeige",
-    "DC HOLD",    "Wechselspannung, Anzeige gestoppt",
-    "BAT",        "Batterie Warnung",
+const char *binaryKeys[] = { BINARY_KEYS(BINARY_KEY_NAME) };
 
-    NULL,NULL,
-};
-// clang-format on
+// Index into binaryKeys[]
+enum BinaryKey { BINARY_KEYS(BINARY_KEY_ENUM) };
 
-// --------------------------------------------------------------------------------------------------------------
+#define BINARY_KEY_COUNT (int)(sizeof(binaryKeys) / sizeof(binaryKeys[0]))
+#define BINARY_KEY_LEN   24  // Max. encoded key length
 
-const char *textToSpeech(const char *in)
-{
-    if (!*in) return "";
+bool binaryIntKeys = false;  // "-k int"
 
-    int i = 0;
-    while (textToSpeechData[i]) {
-        if (strequal(textToSpeechData[i], in)) return textToSpeechData[i + 1];
-        i += 2;
-    }
-    fprintf(stderr, "unknown text |%s|\n", in);
-    return "Unbekannter Text";
+byte binaryBuffer[BINARY_RECORD_LEN];
+int  binaryLen = 0;
+
+void binaryPut(const void *data, int len)
+{
+    if (binaryLen + len > BINARY_RECORD_LEN) exitWithError("Binary record too long");
+    memcpy(binaryBuffer + binaryLen, data, len);
+    binaryLen += len;
 }
 
-// --------------------------------------------------------------------------------------------------------------
+void binaryPutByte(byte b) { binaryPut(&b, 1); }
 
-struct Vc830 *lastSpeechData = NULL;
+// Big endian, as used by CBOR and MessagePack
+void binaryPutUint(unsigned long long value, int bytes)
+{
+    byte buf[8];
+    for (int n = bytes - 1; n >= 0; n--, value >>= 8) buf[n] = value & 0xff;
+    binaryPut(buf, bytes);
+}
 
-void initLastSpeechData()
+void binaryPutDouble(byte float32Type, byte float64Type, double value)
 {
-    if (lastSpeechData != NULL) return;
-    lastSpeechData = malloc(sizeof(*lastSpeechData));
-    memset(lastSpeechData, 0, sizeof(*lastSpeechData));
+    float f = (float)value;
+    if ((double)f == value || isnan(value)) {  // Exact as float, e.g. 0.5 or integral values
+        unsigned u;
+        memcpy(&u, &f, sizeof(u));
+        binaryPutByte(float32Type);
+        binaryPutUint(u, 4);
+        return;
+    }
+    unsigned long long u;
+    memcpy(&u, &value, sizeof(u));
+    binaryPutByte(float64Type);
+    binaryPutUint(u, 8);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-bool checkSpeechStr(char *oldTxt, const char *newTxt, const char *flag)
+//
+// One encoder per binary format. The keys are precomputed by initBinaryKeys().
+//
+struct BinaryCodec {
+    void (*map)(int size);
+    void (*text)(const char *value);
+    void (*integer)(long long value);
+    void (*number)(double value);
+    void (*boolean)(bool value);
+    void (*null)();
+    void (*timestamp)(struct timeval value);
+    byte keyCode[BINARY_KEY_COUNT][BINARY_KEY_LEN];
+    int  keyLen[BINARY_KEY_COUNT];
+};
+
+// CBOR (RFC 8949) head with the shortest argument encoding
+void cborHead(int major, unsigned long long arg)
 {
-    //printf("old = |%s|  new = |%s|  flag = |%s|  \n", oldTxt, newTxt, flag);
+    byte type = major << 5;
 
-    if (!strequal(oldTxt, newTxt) && strstr(newTxt, flag)) {
-        fprintf(stdout, "%s\n", textToSpeech(flag));
-        strncpy(oldTxt, newTxt, BUFFER_LEN);
-        return true;
+    if (arg < 24) {
+        binaryPutByte(type | arg);
+    }
+    else if (arg <= 0xff) {
+        binaryPutByte(type | 24);
+        binaryPutUint(arg, 1);
+    }
+    else if (arg <= 0xffff) {
+        binaryPutByte(type | 25);
+        binaryPutUint(arg, 2);
+    }
+    else if (arg <= 0xffffffffull) {
+        binaryPutByte(type | 26);
+        binaryPutUint(arg, 4);
+    }
+    else {
+        binaryPutByte(type | 27);
+        binaryPutUint(arg, 8);
     }
-    return false;
 }
 
-// --------------------------------------------------------------------------------------------------------------
+void cborMap(int size) { cborHead(5, size); }
+void cborInteger(long long value) { value >= 0 ? cborHead(0, value) : cborHead(1, -1 - value); }
+void cborNumber(double value) { binaryPutDouble(0xfa, 0xfb, value); }
+void cborBoolean(bool value) { binaryPutByte(value ? 0xf5 : 0xf4); }
+void cborNull() { binaryPutByte(0xf6); }
 
-bool checkSpeechBool(bool oldBool, bool newBool, const char *flag)
+void cborText(const char *value)
 {
-    if (oldBool != newBool && newBool) {
-        fprintf(stdout, "%s\n", textToSpeech(flag));
-    }
-    return newBool;
+    int len = strlen(value);
+    cborHead(3, len);
+    binaryPut(value, len);
+}
+
+// Tag 1: epoch based date/time
+void cborTimestamp(struct timeval value)
+{
+    cborHead(6, 1);
+    binaryPutDouble(0xfa, 0xfb, value.tv_sec + value.tv_usec / 1000000.0);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
-int showDataSpeech(struct Vc830 *vc830Data, const char *timeText)
+void msgpackMap(int size)
 {
-    int ret = 0;
-
-    initLastSpeechData();
+    if (size < 16) {
+        binaryPutByte(0x80 | size);
+    }
+    else {
+        binaryPutByte(0xde);
+        binaryPutUint(size, 2);
+    }
+}
 
-    lastSpeechData->overflow = checkSpeechBool(lastSpeechData->overflow, vc830Data->overflow, "OVF");
-    if (lastSpeechData->overflow) return ret;
+void msgpackInteger(long long value)
+{
+    if (value >= 0) {
+        if (value < 128) {
+            binaryPutByte(value);  // positive fixint
+        }
+        else if (value <= 0xff) {
+            binaryPutByte(0xcc);
+            binaryPutUint(value, 1);
+        }
+        else if (value <= 0xffff) {
+            binaryPutByte(0xcd);
+            binaryPutUint(value, 2);
+        }
+        else if (value <= 0xffffffffll) {
+            binaryPutByte(0xce);
+            binaryPutUint(value, 4);
+        }
+        else {
+            binaryPutByte(0xcf);
+            binaryPutUint(value, 8);
+        }
+    }
+    else {
+        if (value >= -32) {
+            binaryPutByte(0xe0 | (value + 32));  // negative fixint
+        }
+        else if (value >= -128) {
+            binaryPutByte(0xd0);
+            binaryPutUint(value, 1);
+        }
+        else if (value >= -32768) {
+            binaryPutByte(0xd1);
+            binaryPutUint(value, 2);
+        }
+        else if (value >= INT_MIN) {
+            binaryPutByte(0xd2);
+            binaryPutUint(value, 4);
+        }
+        else {
+            binaryPutByte(0xd3);
+            binaryPutUint(value, 8);
+        }
+    }
+}
+
+void msgpackText(const char *value)
+{
+    int len = strlen(value);
+
+    if (len < 32) {
+        binaryPutByte(0xa0 | len);
+    }
+    else if (len <= 0xff) {
+        binaryPutByte(0xd9);
+        binaryPutUint(len, 1);
+    }
+    else {
+        binaryPutByte(0xda);
+        binaryPutUint(len, 2);
+    }
+    binaryPut(value, len);
+}
+
+void msgpackNumber(double value) { binaryPutDouble(0xca, 0xcb, value); }
+void msgpackBoolean(bool value) { binaryPutByte(value ? 0xc3 : 0xc2); }
+void msgpackNull() { binaryPutByte(0xc0); }
+
+// Timestamp extension type -1, timestamp 64 format: nanoseconds in the upper 30 bits, seconds in the lower 34 bits
+void msgpackTimestamp(struct timeval value)
+{
+    binaryPutByte(0xd7);
+    binaryPutByte(0xff);
+    binaryPutUint(((unsigned long long)value.tv_usec * 1000 << 34) | (unsigned long long)value.tv_sec, 8);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+struct BinaryCodec cborCodec    = { cborMap, cborText, cborInteger, cborNumber, cborBoolean, cborNull, cborTimestamp };
+struct BinaryCodec msgpackCodec = { msgpackMap, msgpackText, msgpackInteger, msgpackNumber, msgpackBoolean, msgpackNull,
+                                    msgpackTimestamp };
+
+void initBinaryKeys(struct BinaryCodec *codec)
+{
+    for (int k = 0; k < BINARY_KEY_COUNT; k++) {
+        binaryLen = 0;
+        if (binaryIntKeys)
+            codec->integer(k);
+        else
+            codec->text(binaryKeys[k]);
+
+        if (binaryLen > BINARY_KEY_LEN) exitWithError("Binary key too long");
+        memcpy(codec->keyCode[k], binaryBuffer, binaryLen);
+        codec->keyLen[k] = binaryLen;
+    }
+    binaryLen = 0;
+}
+
+void binaryKey(struct BinaryCodec *codec, enum BinaryKey key) { binaryPut(codec->keyCode[key], codec->keyLen[key]); }
+
+// Record keys are interned if they are known, else written as text
+void binaryRecordKey(struct BinaryCodec *codec, const char *key)
+{
+    for (int k = 0; k < BINARY_KEY_COUNT; k++) {
+        if (strequal(binaryKeys[k], key)) {
+            binaryKey(codec, k);
+            return;
+        }
+    }
+    codec->text(key);
+}
+
+int binaryFlush()
+{
+    fwrite(binaryBuffer, 1, binaryLen, output);
+    binaryLen = 0;
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showDataBinary(struct BinaryCodec *codec, struct Vc830 *vc830Data, const char *timeText)
+{
+    codec->map(11 + (*timeText ? 1 : 0) + (sampleDevice ? 1 : 0) + (sampleHasAbsolute ? 2 : 0) + (sampleExtremum ? 1 : 0));
+
+    if (sampleDevice) {
+        binaryKey(codec, KEY_DEVICE);
+        codec->text(sampleDevice);
+    }
+
+    binaryKey(codec, KEY_RECEIVED_AT);
+    codec->timestamp(vc830Data->receivedAt);
+    if (*timeText) {
+        binaryKey(codec, KEY_RECEIVED_AT_FORMATED);
+        codec->text(timeText);
+    }
+    binaryKey(codec, KEY_MODE);
+    codec->text(vc830Data->mode);
+    binaryKey(codec, KEY_UNIT);
+    codec->text(vc830Data->unit);
+    binaryKey(codec, KEY_FULL_UNIT);
+    codec->text(vc830Data->fullUnit);
+    binaryKey(codec, KEY_INFO);
+    codec->text(vc830Data->info);
+    binaryKey(codec, KEY_BAR_GRAPH);
+    if (vc830Data->barGraphIsShown)
+        codec->integer(vc830Data->barGraph);
+    else
+        codec->null();
+    binaryKey(codec, KEY_OVERFLOW);
+    codec->boolean(vc830Data->overflow);
+    binaryKey(codec, KEY_RAW_DISPLAY);
+    codec->text(vc830Data->rawRisplay);
+    binaryKey(codec, KEY_VALUE);  // In the display unit (fullUnit)
+    if (vc830Data->overflow)
+        codec->null();
+    else
+        codec->number(strtod(vc830Data->value, NULL));
+    binaryKey(codec, KEY_SI_VALUE);  // In the SI base unit (unit)
+    if (vc830Data->overflow)
+        codec->null();
+    else
+        codec->number(vc830Data->siValue);
+    binaryKey(codec, KEY_STATUS);
+    codec->integer(vc830Data->status);
+    if (sampleHasAbsolute) {
+        binaryKey(codec, KEY_REFERENCE);  // In the SI base unit
+        codec->number(sampleReference);
+        binaryKey(codec, KEY_ABSOLUTE);
+        codec->number(sampleAbsolute);
+    }
+    if (sampleExtremum) {
+        binaryKey(codec, KEY_EXTREMUM);
+        codec->text(sampleExtremum);
+    }
+
+    return binaryFlush();
+}
+
+int showRecordBinary(struct BinaryCodec *codec, struct Record *r, const char *timeText)
+{
+    codec->map(r->fieldCount + (*timeText ? 3 : 2));
+
+    binaryKey(codec, KEY_TYPE);
+    codec->text(r->type);
+    binaryKey(codec, KEY_TIMESTAMP);
+    codec->timestamp(r->timestamp);
+    if (*timeText) {
+        binaryKey(codec, KEY_TIMESTAMP_FORMATED);
+        codec->text(timeText);
+    }
+    for (int i = 0; i < r->fieldCount; i++) {
+        struct RecordField *f = &r->fields[i];
+        binaryRecordKey(codec, f->key);
+        if (f->type == RECORD_STRING) codec->text(f->str);
+        if (f->type == RECORD_INT) codec->integer((long long)f->number);
+        if (f->type == RECORD_DOUBLE) codec->number(f->number);
+        if (f->type == RECORD_BOOL) codec->boolean(f->number != 0);
+    }
+
+    return binaryFlush();
+}
+
+int showDataCbor(struct Vc830 *vc830Data, const char *timeText) { return showDataBinary(&cborCodec, vc830Data, timeText); }
+int showDataMsgpack(struct Vc830 *vc830Data, const char *timeText) { return showDataBinary(&msgpackCodec, vc830Data, timeText); }
+int showRecordCbor(struct Record *r, const char *timeText) { return showRecordBinary(&cborCodec, r, timeText); }
+int showRecordMsgpack(struct Record *r, const char *timeText) { return showRecordBinary(&msgpackCodec, r, timeText); }
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Relay output, read by another vc830 with relay://host:port. Each sample is sent as the raw paket with
+// the receive time, so the relay decodes it like a local one:
+//
+//   'V', name length, sequence number (4 bytes), receivedAt in µs (8 bytes), paket (14 bytes), name
+//
+// Numbers are big endian. The sequence number counts the decoded pakets of the device, gaps are lost
+// samples. Records (statistics, line reports) are not relayed.
+//
+#define RELAY_MAGIC      'V'
+#define RELAY_HEADER_LEN (14 + PAKET_LEN)
+#define RELAY_RECORD_LEN (RELAY_HEADER_LEN + 255)
+
+int showDataRelay(struct Vc830 *vc830Data, const char *timeText)
+{
+    byte      buf[RELAY_RECORD_LEN];
+    size_t    nameLen = strlen(sampleName);
+    long long usec    = vc830Data->receivedAt.tv_sec * 1000000LL + vc830Data->receivedAt.tv_usec;
+
+    if (nameLen > 255) nameLen = 255;
+    buf[0] = RELAY_MAGIC;
+    buf[1] = nameLen;
+    for (int i = 0; i < 4; i++) buf[2 + i] = sampleSeq >> (24 - i * 8);
+    for (int i = 0; i < 8; i++) buf[6 + i] = usec >> (56 - i * 8);
+    memcpy(buf + 14, samplePaket, PAKET_LEN);
+    memcpy(buf + RELAY_HEADER_LEN, sampleName, nameLen);
+
+    fwrite(buf, 1, RELAY_HEADER_LEN + nameLen, output);
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Events output, "-f events". For fixture tests in continuity (SB3 Beep) and diode mode only the
+// transitions between open and short (and conducting for diodes) are printed, one short line each:
+//
+//   <time>  [device]  continuity|diode  open|short|conducting  <value>
+//
+// The time is the receive time of the frame which confirmed the state, in epoch seconds without -t.
+// A state is confirmed after EVENT_DEBOUNCE_FRAMES frames, so a transition is reported one frame
+// period after it was seen. No text fields are decoded, the output is flushed after each event.
+//
+struct EventState {
+    unsigned    mode;     // STATUS_BEEP or STATUS_DIODE of the state, 0 = other mode
+    const char *state;    // Reported state, NULL = none yet
+    const char *pending;  // State of the last frames
+    int         frames;   // Frames with the pending state
+};
+
+struct EventState eventStates[MAX_DEVICES];
+int               sampleIndex = 0;  // Index of the device of the current sample in devices[]
+
+int showDataEvents(struct Vc830 *vc830Data, const char *timeText)
+{
+    struct EventState *e    = &eventStates[sampleIndex];
+    unsigned           mode = vc830Data->status & (STATUS_BEEP | STATUS_DIODE);
+    const char        *state;
+
+    if (mode != e->mode) {
+        e->mode    = mode;
+        e->state   = NULL;
+        e->pending = NULL;
+    }
+    if (mode == 0) return 0;
+
+    if (vc830Data->overflow)
+        state = "open";
+    else if (mode == STATUS_BEEP)
+        state = vc830Data->siValue < EVENT_SHORT_OHM ? "short" : "open";
+    else
+        state = vc830Data->siValue < EVENT_SHORT_VOLT ? "short" : "conducting";
+
+    e->frames  = state == e->pending ? e->frames + 1 : 1;
+    e->pending = state;
+    if (e->frames < EVENT_DEBOUNCE_FRAMES || state == e->state) return 0;
+    e->state = state;
+
+    if (*timeText)
+        fprintf(output, "%s\t", timeText);
+    else
+        fprintf(output, "%ld.%06ld\t", (long)vc830Data->receivedAt.tv_sec, (long)vc830Data->receivedAt.tv_usec);
+    if (sampleDevice) fprintf(output, "%s\t", sampleDevice);
+    fprintf(output, "%s\t%s\t%s\n", mode == STATUS_BEEP ? "continuity" : "diode", state,
+            vc830Data->overflow ? "OL" : formatSi(vc830Data->siValue, mode == STATUS_BEEP ? "Ω" : "V"));
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+// clang-format off
+const char *textToSpeechData[] = {
+    "Ω",          "Ohm",
+    "V",          "Volt",
+    "A",          "Ampere",
+    "hFE",        "Verstärkungsfaktor",     // differentielle Stromverstärkungsfaktor
+    "Hz",         "Herz",
+    "F",          "Farad",
+    "°F",         "Fahrenheit",
+    "°C",         "Celsius",
+
+    "n",         "nano",
+    "µ",         "micro",
+    "m",         "milli",
+    "k",         "kilo",
+    "M",         "mega",
+    "%",         "Prozent",
+
+    "OVF",        "Überlauf",
+    "AUTO",       "Automatische Bereichswahl",
+    "DC",         "Gleichspannung",
+    "DC REL",     "Gleichspannung, relative Anzeige",
+    "DC HOLD",    "Gleichspannung, Anzeige gestoppt",
+    "AC",         "Wechselspannung",
+    "AC REL",     "Wechselspannung, relative Anzeige",
+    "DC HOLD",    "Wechselspannung, Anzeige gestoppt",
+    "BAT",        "Batterie Warnung",
+
+    NULL,NULL,
+};
+// clang-format on
+
+// --------------------------------------------------------------------------------------------------------------
+
+const char *textToSpeech(const char *in)
+{
+    if (!*in) return "";
+
+    int i = 0;
+    while (textToSpeechData[i]) {
+        if (strequal(textToSpeechData[i], in)) return textToSpeechData[i + 1];
+        i += 2;
+    }
+    fprintf(stderr, "unknown text |%s|\n", in);
+    return "Unbekannter Text";
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+struct Vc830  lastSpeechDataBuffer;
+struct Vc830 *lastSpeechData = NULL;
+
+void initLastSpeechData()
+{
+    if (lastSpeechData != NULL) return;
+    lastSpeechData = &lastSpeechDataBuffer;
+    memset(lastSpeechData, 0, sizeof(*lastSpeechData));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+bool checkSpeechStr(char *oldTxt, const char *newTxt, const char *flag)
+{
+    //printf("old = |%s|  new = |%s|  flag = |%s|  \n", oldTxt, newTxt, flag);
+
+    if (!strequal(oldTxt, newTxt) && strstr(newTxt, flag)) {
+        fprintf(output, "%s\n", textToSpeech(flag));
+        strncpy(oldTxt, newTxt, BUFFER_LEN);
+        return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+bool checkSpeechBool(bool oldBool, bool newBool, const char *flag)
+{
+    if (oldBool != newBool && newBool) {
+        fprintf(output, "%s\n", textToSpeech(flag));
+    }
+    return newBool;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showDataSpeech(struct Vc830 *vc830Data, const char *timeText)
+{
+    int ret = 0;
+
+    initLastSpeechData();
+
+    lastSpeechData->overflow = checkSpeechBool(lastSpeechData->overflow, vc830Data->overflow, "OVF");
+    if (lastSpeechData->overflow) return ret;
+
+    lastSpeechData->batteryWarning = checkSpeechBool(lastSpeechData->batteryWarning, vc830Data->batteryWarning, "BAT");
+
+    checkSpeechStr(lastSpeechData->info, vc830Data->info, "AUTO");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC REL");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC HOLD");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC REL");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC HOLD");
+    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC");
+
+    if (!strequal(lastSpeechData->formatedValue, vc830Data->formatedValue)) {
+
+        char   buf[BUFFER_LEN];
+        double vSpeach = atof(vc830Data->value) * (vc830Data->sign == '-' ? -1 : 1);
+
+        // Patch for german outout... (the ugly way..., but my locale is normally "en"...)
+        if (strchr(vc830Data->value, '.')) {
+
+            // We limit the the spoken output to one digit after komma
+            snprintf(buf, sizeof(buf), "%1.1f", vSpeach);
+
+            char *k = strchr(buf, '.');
+            if (k) {
+                *k = ',';
+            }
+        }
+        else {
+            snprintf(buf, sizeof(buf), "%1.0f", vSpeach);
+        }
+
+        if (!strequal(lastSpeechData->lastSpeechOutput, buf)) {
+            fprintf(output, "%s %s %s\n", buf, textToSpeech(vc830Data->prefix), textToSpeech(vc830Data->unit));
+            strncpy(lastSpeechData->lastSpeechOutput, buf, BUFFER_LEN);
+            ret = 1;    // Data output done
+            //fprintf(output, "%s %s %s %s\n", vc830Data->value, buf, textToSpeech(vc830Data->prefix), textToSpeech(vc830Data->unit));
+        }
+        strncpy(lastSpeechData->formatedValue, vc830Data->formatedValue, BUFFER_LEN);
+    }
+    //fprintf(output, "----------------------\n");
+    //showDataKeyValue(vc830Data, timeText);
+    //fprintf(output, "----------------------\n");
+
+    return ret;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+// clang-format off
+struct OutputFormat {
+    const char *name;
+    unsigned    fields;  // Fields of struct Vc830 read by the show function (FIELD_xxx)
+    int (*show)(struct Vc830 *vc830Data, const char *timeText);
+    int (*showRecord)(struct Record *record, const char *timeText);
+};
+
+const struct OutputFormat outputFormats[] = {
+    { "keyvalue", FIELD_ALL,                                                              showDataKeyValue, showRecordKeyValue },
+    { "json",     FIELD_ALL,                                                              showDataJson,     showRecordJson     },
+    { "human",    FIELD_FORMATED_VALUE | FIELD_MODE | FIELD_INFO,                         showDataHuman,    showRecordHuman    },
+    { "si",       FIELD_FORMATED_SI | FIELD_MODE | FIELD_INFO,                            showDataSi,       showRecordHuman    },
+    { "speech",   FIELD_FORMATED_VALUE | FIELD_VALUE | FIELD_UNIT | FIELD_MODE | FIELD_INFO, showDataSpeech,   showRecordNone     },
+    { "cbor",     FIELD_RAW_DISPLAY | FIELD_VALUE | FIELD_UNIT | FIELD_MODE | FIELD_INFO,    showDataCbor,     showRecordCbor     },
+    { "msgpack",  FIELD_RAW_DISPLAY | FIELD_VALUE | FIELD_UNIT | FIELD_MODE | FIELD_INFO,    showDataMsgpack,  showRecordMsgpack  },
+    { "relay",    0,                                                                      showDataRelay,    showRecordNone     },
+    { "events",   0,                                                                      showDataEvents,   showRecordNone     },
+
+    { NULL, 0, NULL, NULL },
+};
+// clang-format on
+
+// --------------------------------------------------------------------------------------------------------------
+
+const struct OutputFormat *findOutputFormat(const char *name)
+{
+    for (const struct OutputFormat *f = outputFormats; f->name; f++) {
+        if (strequal(f->name, name)) return f;
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+const char *formatTime(struct timeval t, const char *timeFormat)
+{
+    const char *timeText = NULL;
+
+    // iso, local, epochsecms, human, none
+    if (strequal(timeFormat, "iso")) {
+        timeText = getIso8601Time(t);
+    }
+    if (strequal(timeFormat, "local")) {
+        timeText = getLocalDateTime(t);
+    }
+    if (strequal(timeFormat, "human")) {
+        timeText = getLocalTime(t);
+    }
+    if (strequal(timeFormat, "epochsecms")) {
+        timeText = getEpochSecMsTime(t);
+    }
+    if (strequal(timeFormat, "none")) {
+        timeText = "";
+    }
+
+    if (timeText == NULL) showUsageAndExit("Unknown time format.");
+
+    return timeText;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Outputs data for the given format.
+// Return:  1 = Data printed
+//          0 = Data not printed
+//
+int showData(struct Vc830 *vc830Data, const struct OutputFormat *outputFormat,
+             const char *timeFormat)
+{
+    return outputFormat->show(vc830Data, formatTime(vc830Data->receivedAt, timeFormat));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+int showRecord(struct Record *record, const struct OutputFormat *outputFormat,
+               const char *timeFormat)
+{
+    return outputFormat->showRecord(record, formatTime(record->timestamp, timeFormat));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Aggregation kernels. The samples are collected as structure of arrays (struct SampleBatch)
+// and reduced batch wise into a struct Aggregate. The kernels are built in several variants
+// and the best one for the running CPU is selected by initKernels().
+//
+struct SampleBatch {
+    int      count;              // Number of samples in time[] and status[]
+    int      valueCount;         // Number of values in value[], overflows have no value
+    int      skipped;            // Samples without a value which are no overflows, see aggregateSample()
+    double   time[BATCH_LEN];    // Receive time in seconds since epoch
+    unsigned status[BATCH_LEN];  // struct Vc830.status
+    double   value[BATCH_LEN];   // struct Vc830.siValue
+};
+
+// clang-format off
+struct AggregateFlag {
+    const char *key;
+    unsigned    mask;
+};
+
+const struct AggregateFlag aggregateFlags[] = {
+    { "countAuto", STATUS_AUTO },
+    { "countHold", STATUS_HOLD },
+    { "countRel",  STATUS_REL  },
+    { "countMin",  STATUS_MIN  },
+    { "countMax",  STATUS_MAX  },
+    { "countBat",  STATUS_BAT  },
+};
+// clang-format on
+
+#define AGGREGATE_FLAG_COUNT (int)(sizeof(aggregateFlags) / sizeof(aggregateFlags[0]))
+
+struct Aggregate {
+    long   samples;  // All samples
+    long   values;   // Samples with a value
+    long   skipped;  // Samples without a value which are no overflows
+    double sum;
+    double sumSq;
+    double min;
+    double max;
+    double from;  // First/last sample time
+    double to;
+    long   flagCount[AGGREGATE_FLAG_COUNT];
+    double twSum;  // Time weighted: value * seconds, a value holds until the next sample of the device
+    double twSumSq;
+    double twTime;   // Seconds with a value
+    double twAbove;  // Seconds with a value above statsLevel
+    long   gaps;     // Times between two samples longer than STATS_GAP_SEC
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+void aggregateValuesScalar(const double *v, int n, struct Aggregate *a)
+{
+    double sum = 0, sumSq = 0, min = a->min, max = a->max;
+
+    for (int i = 0; i < n; i++) {
+        sum += v[i];
+        sumSq += v[i] * v[i];
+        if (v[i] < min) min = v[i];
+        if (v[i] > max) max = v[i];
+    }
+    a->sum += sum;
+    a->sumSq += sumSq;
+    a->min = min;
+    a->max = max;
+}
+
+long countFlagsScalar(const unsigned *status, int n, unsigned mask)
+{
+    long count = 0;
+    for (int i = 0; i < n; i++) count += (status[i] & mask) != 0;
+    return count;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+#if defined(KERNELS_X86)
+
+__attribute__((target("sse2"))) void aggregateValuesSse2(const double *v, int n, struct Aggregate *a)
+{
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    __m128d sq0 = _mm_setzero_pd(), sq1 = _mm_setzero_pd();
+    __m128d min = _mm_set1_pd(a->min), max = _mm_set1_pd(a->max);
+    int     i   = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128d x0 = _mm_loadu_pd(v + i);
+        __m128d x1 = _mm_loadu_pd(v + i + 2);
+        sum0       = _mm_add_pd(sum0, x0);
+        sum1       = _mm_add_pd(sum1, x1);
+        sq0        = _mm_add_pd(sq0, _mm_mul_pd(x0, x0));
+        sq1        = _mm_add_pd(sq1, _mm_mul_pd(x1, x1));
+        min        = _mm_min_pd(min, _mm_min_pd(x0, x1));
+        max        = _mm_max_pd(max, _mm_max_pd(x0, x1));
+    }
+
+    double s[2], q[2], mi[2], ma[2];
+    _mm_storeu_pd(s, _mm_add_pd(sum0, sum1));
+    _mm_storeu_pd(q, _mm_add_pd(sq0, sq1));
+    _mm_storeu_pd(mi, min);
+    _mm_storeu_pd(ma, max);
+
+    a->sum += s[0] + s[1];
+    a->sumSq += q[0] + q[1];
+    a->min = mi[0] < mi[1] ? mi[0] : mi[1];
+    a->max = ma[0] > ma[1] ? ma[0] : ma[1];
+
+    aggregateValuesScalar(v + i, n - i, a);  // Tail
+}
+
+__attribute__((target("sse2"))) long countFlagsSse2(const unsigned *status, int n, unsigned mask)
+{
+    __m128i m    = _mm_set1_epi32(mask);
+    __m128i zero = _mm_setzero_si128();
+    __m128i none = _mm_setzero_si128();  // Per lane count of samples without flag (as -1 steps)
+    int     i    = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)(status + i)), m);
+        none      = _mm_add_epi32(none, _mm_cmpeq_epi32(x, zero));
+    }
+
+    int c[4];
+    _mm_storeu_si128((__m128i *)c, none);
+
+    return i + (c[0] + c[1] + c[2] + c[3]) + countFlagsScalar(status + i, n - i, mask);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+__attribute__((target("avx2"))) void aggregateValuesAvx2(const double *v, int n, struct Aggregate *a)
+{
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sq0 = _mm256_setzero_pd(), sq1 = _mm256_setzero_pd();
+    __m256d min = _mm256_set1_pd(a->min), max = _mm256_set1_pd(a->max);
+    int     i   = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(v + i);
+        __m256d x1 = _mm256_loadu_pd(v + i + 4);
+        sum0       = _mm256_add_pd(sum0, x0);
+        sum1       = _mm256_add_pd(sum1, x1);
+        sq0        = _mm256_add_pd(sq0, _mm256_mul_pd(x0, x0));
+        sq1        = _mm256_add_pd(sq1, _mm256_mul_pd(x1, x1));
+        min        = _mm256_min_pd(min, _mm256_min_pd(x0, x1));
+        max        = _mm256_max_pd(max, _mm256_max_pd(x0, x1));
+    }
+
+    double s[4], q[4], mi[4], ma[4];
+    _mm256_storeu_pd(s, _mm256_add_pd(sum0, sum1));
+    _mm256_storeu_pd(q, _mm256_add_pd(sq0, sq1));
+    _mm256_storeu_pd(mi, min);
+    _mm256_storeu_pd(ma, max);
+
+    for (int l = 0; l < 4; l++) {
+        a->sum += s[l];
+        a->sumSq += q[l];
+        if (mi[l] < a->min) a->min = mi[l];
+        if (ma[l] > a->max) a->max = ma[l];
+    }
+
+    aggregateValuesScalar(v + i, n - i, a);  // Tail
+}
+
+__attribute__((target("avx2"))) long countFlagsAvx2(const unsigned *status, int n, unsigned mask)
+{
+    __m256i m    = _mm256_set1_epi32(mask);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i none = _mm256_setzero_si256();  // Per lane count of samples without flag (as -1 steps)
+    int     i    = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(status + i)), m);
+        none      = _mm256_add_epi32(none, _mm256_cmpeq_epi32(x, zero));
+    }
+
+    int  c[8];
+    long sum = 0;
+    _mm256_storeu_si256((__m256i *)c, none);
+    for (int l = 0; l < 8; l++) sum += c[l];
+
+    return i + sum + countFlagsScalar(status + i, n - i, mask);
+}
+
+#endif  // KERNELS_X86
+
+// --------------------------------------------------------------------------------------------------------------
+
+#if defined(KERNELS_NEON)
+
+#if defined(__aarch64__)
+void aggregateValuesNeon(const double *v, int n, struct Aggregate *a)
+{
+    float64x2_t sum0 = vdupq_n_f64(0), sum1 = vdupq_n_f64(0);
+    float64x2_t sq0 = vdupq_n_f64(0), sq1 = vdupq_n_f64(0);
+    float64x2_t min = vdupq_n_f64(a->min), max = vdupq_n_f64(a->max);
+    int         i   = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        float64x2_t x0 = vld1q_f64(v + i);
+        float64x2_t x1 = vld1q_f64(v + i + 2);
+        sum0           = vaddq_f64(sum0, x0);
+        sum1           = vaddq_f64(sum1, x1);
+        sq0            = vfmaq_f64(sq0, x0, x0);
+        sq1            = vfmaq_f64(sq1, x1, x1);
+        min            = vminq_f64(min, vminq_f64(x0, x1));
+        max            = vmaxq_f64(max, vmaxq_f64(x0, x1));
+    }
+
+    a->sum += vaddvq_f64(vaddq_f64(sum0, sum1));
+    a->sumSq += vaddvq_f64(vaddq_f64(sq0, sq1));
+    a->min = vminvq_f64(min);
+    a->max = vmaxvq_f64(max);
+
+    aggregateValuesScalar(v + i, n - i, a);  // Tail
+}
+#else
+#define aggregateValuesNeon aggregateValuesScalar  // ARMv7 NEON has no double precision lanes
+#endif
+
+long countFlagsNeon(const unsigned *status, int n, unsigned mask)
+{
+    uint32x4_t m   = vdupq_n_u32(mask);
+    uint32x4_t has = vdupq_n_u32(0);  // Per lane count of samples with flag
+    int        i   = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t x = vtstq_u32(vld1q_u32(status + i), m);  // All ones if (status & mask) != 0
+        has          = vsubq_u32(has, x);
+    }
+
+    uint32_t c[4];
+    vst1q_u32(c, has);
+
+    return (long)c[0] + c[1] + c[2] + c[3] + countFlagsScalar(status + i, n - i, mask);
+}
+
+#endif  // KERNELS_NEON
+
+// --------------------------------------------------------------------------------------------------------------
+
+bool cpuHasAll() { return true; }
+
+#if defined(KERNELS_X86)
+bool cpuHasSse2() { return __builtin_cpu_supports("sse2"); }
+bool cpuHasAvx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+#if defined(KERNELS_NEON)
+bool cpuHasNeon()
+{
+#if defined(__linux__) && !defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return true;  // Mandatory on AArch64
+#endif
+}
+#endif
+
+// clang-format off
+struct Kernels {
+    const char *name;
+    bool (*cpuSupported)();
+    void (*aggregateValues)(const double *v, int n, struct Aggregate *a);
+    long (*countFlags)(const unsigned *status, int n, unsigned mask);
+};
+
+// Ordered by preference, the first supported entry is used
+const struct Kernels kernelVariants[] = {
+#if defined(KERNELS_X86)
+    { "avx2",   cpuHasAvx2, aggregateValuesAvx2,   countFlagsAvx2   },
+    { "sse2",   cpuHasSse2, aggregateValuesSse2,   countFlagsSse2   },
+#endif
+#if defined(KERNELS_NEON)
+    { "neon",   cpuHasNeon, aggregateValuesNeon,   countFlagsNeon   },
+#endif
+    { "scalar", cpuHasAll,  aggregateValuesScalar, countFlagsScalar },
+
+    { NULL, NULL, NULL, NULL },
+};
+// clang-format on
+
+const struct Kernels *kernels = NULL;  // Set by initKernels()
+
+//
+// Selects the kernels for the running CPU. The environment variable VC830_KERNELS can be
+// used to force a variant (e.g. for benchmarks).
+//
+void initKernels()
+{
+    const char *forced = getenv("VC830_KERNELS");
+
+#if defined(KERNELS_X86)
+    __builtin_cpu_init();
+#endif
+
+    for (const struct Kernels *k = kernelVariants; k->name; k++) {
+        if (forced && !strequal(forced, k->name)) continue;
+        if (!k->cpuSupported()) continue;
+        kernels = k;
+        return;
+    }
+    if (forced) exitWithError("Kernels selected by VC830_KERNELS not available");
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+void aggregateReset(struct Aggregate *a)
+{
+    memset(a, 0, sizeof(*a));
+    a->min = INFINITY;
+    a->max = -INFINITY;
+}
+
+// Reduces the batch into the aggregate and empties the batch
+void aggregateBatch(struct SampleBatch *b, struct Aggregate *a)
+{
+    if (b->count == 0) return;
+
+    if (a->samples == 0) a->from = b->time[0];
+    a->to = b->time[b->count - 1];
+    a->samples += b->count;
+    a->values += b->valueCount;
+    a->skipped += b->skipped;
+
+    kernels->aggregateValues(b->value, b->valueCount, a);
+    for (int f = 0; f < AGGREGATE_FLAG_COUNT; f++) {
+        a->flagCount[f] += kernels->countFlags(b->status, b->count, aggregateFlags[f].mask);
+    }
+
+    b->count      = 0;
+    b->valueCount = 0;
+    b->skipped    = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Window statistics, used with "-a <window>".
+//
+struct SampleBatch statsBatch;
+struct Aggregate   statsAggregate;
+unsigned           statsUnitStatus = 0;  // Unit and AC/DC bits of the current window
+char               statsUnit[BUFFER_LEN];
+double             statsLevel;  // "-a window,level", the duty cycle is the time above
+bool               statsHasLevel = false;
+
+// Last value of each device for the time weighted statistics
+struct StatsHold {
+    double   time;
+    double   value;
+    bool     valid;  // The sample had a value
+    unsigned unit;   // Unit and AC/DC bits
+};
+
+struct StatsHold statsHolds[MAX_DEVICES];
+
+const char *modeName(unsigned status) { return status & STATUS_AC ? "AC" : status & STATUS_DC ? "DC" : ""; }
+
+// Outputs the statistics of the current window. Return value like showData().
+int showStats(const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct Aggregate *a = &statsAggregate;
+    static struct Record r;
+
+    aggregateBatch(&statsBatch, a);
+    if (a->samples == 0) return 0;
+
+    struct timeval to = { (time_t)a->to, (suseconds_t)((a->to - (time_t)a->to) * 1000000) };
+    recordBegin(&r, "stats", to);
+
+    recordString(&r, "unit", statsUnit);
+    if (*modeName(statsUnitStatus)) recordString(&r, "mode", modeName(statsUnitStatus));
+    recordInt(&r, "samples", a->samples);
+    recordInt(&r, "overflows", a->samples - a->values - a->skipped);
+    if (a->values > 0) {
+        double mean     = a->sum / a->values;
+        double variance = a->sumSq / a->values - mean * mean;
+
+        recordDouble(&r, "min", a->min);
+        recordDouble(&r, "max", a->max);
+        recordDouble(&r, "mean", mean);
+        recordDouble(&r, "rms", sqrt(a->sumSq / a->values));
+        recordDouble(&r, "stddev", variance > 0 ? sqrt(variance) : 0);
+    }
+    recordDouble(&r, "duration", a->to - a->from);
+    if (a->twTime > 0) {
+        recordDouble(&r, "twMean", a->twSum / a->twTime);
+        recordDouble(&r, "twRms", sqrt(a->twSumSq / a->twTime));
+        recordDouble(&r, "twDuration", a->twTime);
+        if (statsHasLevel) {
+            recordDouble(&r, "level", statsLevel);
+            recordDouble(&r, "duty", a->twAbove / a->twTime);
+        }
+    }
+    recordInt(&r, "gaps", a->gaps);
+    for (int f = 0; f < AGGREGATE_FLAG_COUNT; f++) {
+        recordInt(&r, aggregateFlags[f].key, a->flagCount[f]);
+    }
+
+    aggregateReset(a);
+
+    return showRecord(&r, outputFormat, timeFormat);
+}
+
+// Adds the sample to the current window and outputs the statistics if the window is complete
+// or the unit or AC/DC changes. Returns the number of printed records.
+int aggregateSample(struct Vc830 *vc830Data, long window, const struct OutputFormat *outputFormat,
+                    const char *timeFormat)
+{
+    struct SampleBatch *b   = &statsBatch;
+    int                 ret = 0;
+
+    unsigned unitStatus = vc830Data->status & (STATUS_UNITS | STATUS_AC | STATUS_DC);
+    if (unitStatus != statsUnitStatus) {
+        ret             = showStats(outputFormat, timeFormat);  // Units, AC and DC can't be mixed
+        statsUnitStatus = unitStatus;
+    }
+    strcpy(statsUnit, vc830Data->unit);
+
+    double t            = vc830Data->receivedAt.tv_sec + vc830Data->receivedAt.tv_usec / 1000000.0;
+    b->time[b->count]   = t;
+    b->status[b->count] = vc830Data->status;
+    b->count++;
+
+    bool skipped = (holdAware && (vc830Data->status & (STATUS_HOLD | STATUS_MIN | STATUS_MAX))) ||  // No new measurement
+                   (relAbsolute && (vc830Data->status & STATUS_REL) && !sampleHasAbsolute);         // Unknown reference
+    bool   hasValue = !vc830Data->overflow && !skipped;
+    double value    = sampleHasAbsolute ? sampleAbsolute : vc830Data->siValue;
+    if (hasValue)
+        b->value[b->valueCount++] = value;
+    else if (skipped)
+        b->skipped++;  // Only counted
+
+    // Time weighted: the last value of the device held until now. Overflows and gaps have no weight.
+    struct StatsHold *h  = &statsHolds[sampleIndex];
+    struct Aggregate *a  = &statsAggregate;
+    double            dt = t - h->time;
+    if (h->valid && h->unit == unitStatus && dt > 0) {
+        if (dt > STATS_GAP_SEC) {
+            a->gaps++;
+        }
+        else {
+            a->twSum += h->value * dt;
+            a->twSumSq += h->value * h->value * dt;
+            a->twTime += dt;
+            if (statsHasLevel && h->value > statsLevel) a->twAbove += dt;
+        }
+    }
+    h->time  = t;
+    h->unit  = unitStatus;
+    h->valid = hasValue;
+    h->value = value;
+
+    if (b->count == BATCH_LEN) aggregateBatch(b, &statsAggregate);
+
+    if (statsAggregate.samples + b->count >= window) ret += showStats(outputFormat, timeFormat);
+    return ret;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Flight recorder, enabled with "-d dir". Each device keeps its last RECORDER_LEN received bytes
+// with the arrival times in a ring. There is only one writer (the main loop), the ring is dumped
+// from the main loop too, so no locking is needed. See recorderDump().
+//
+struct Recorder {
+    byte           bytes[RECORDER_LEN];
+    unsigned       gapUsec[RECORDER_LEN];  // Time since the previous byte, saturated
+    long           count;                  // Bytes received, the ring holds the last RECORDER_LEN
+    struct timeval lastAt;                 // Arrival time of the newest byte
+    struct timeval lastDumpAt;             // Automatic dumps are rate limited
+    struct timeval burstStart;             // Decode errors within RECORDER_BURST_SEC
+    int            burstErrors;
+    long           dumps;
+    int            markState;  // PARMRK escape of "-q" in progress, see recorderPush()
+};
+
+const char *recorderDir = NULL;  // "-d dir"
+
+// 64 bit, a 32 bit long overflows after 35 minutes
+long long usecBetween(struct timeval from, struct timeval to)
+{
+    return (to.tv_sec - from.tv_sec) * 1000000LL + (to.tv_usec - from.tv_usec);
+}
+
+// With marked, buf has the escapes of enableLineErrorMarks(). Only the bytes from the line are recorded,
+// like framerPushMarked() reads them: \377 \377 is 0xff, \377 \0 x is x.
+void recorderPush(struct Recorder *r, const byte *buf, int len, bool marked, struct timeval now)
+{
+    long long gap = r->count == 0 ? 0 : usecBetween(r->lastAt, now);  // One time per read()
+
+    for (int i = 0; i < len; i++) {
+        if (marked) {
+            int state    = r->markState;
+            r->markState = state == 0 ? buf[i] == 0xff : state == 1 && buf[i] != 0xff ? 2 : 0;
+            if (r->markState != 0) continue;
+        }
+        int idx = r->count++ % RECORDER_LEN;
+
+        r->bytes[idx]   = buf[i];
+        r->gapUsec[idx] = gap < 0 ? 0 : gap > UINT_MAX ? UINT_MAX : gap;
+        gap             = 0;
+    }
+    r->lastAt = now;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Regression sums of the "-r" trend per time bucket. The window is the sum of the last TREND_BUCKETS
+// buckets, so a sample is added in O(1) and the window slides by one bucket at a time.
+//
+struct TrendSums {
+    long   n;
+    double t, y, tt, ty, yy;  // Linear fit, t in seconds since Trend.origin
+    long   positive;          // Samples with y > 0, the exponential fit needs all y > 0 or all y < 0
+    long   negative;
+    double ly, tly, lyly;  // Exponential fit, ly = ln|y|
+};
+
+struct Trend {
+    struct TrendSums buckets[TREND_BUCKETS];
+    struct TrendSums window;  // Sum of the buckets
+    long             bucket;  // Number of the current bucket since origin
+    struct timeval   origin;  // Time of the first sample, 0 = no samples
+    unsigned         unit;    // Unit bits of the samples, a new unit restarts the trend
+};
+
+// Steps and errors of the "-s" calibration schedule per range of a device
+struct CalRange {
+    unsigned status;      // Unit bits and STATUS_AC/STATUS_DC
+    int      rangeDigit;  // Range digit of the paket, buf[6]
+    double   resolution;
+    int      steps;
+    int      passed;
+    double   worst;  // Max. |error| / limit
+};
+
+// Time per range and switches of the "-u" autorange report
+struct RangeTime {
+    unsigned status;      // Unit bits and STATUS_AC/STATUS_DC
+    int      rangeDigit;  // buf[6]
+    double   resolution;
+    long     frames;
+    double   seconds;
+    long     nearTop;  // Frames with the bar graph near the switch to the next range
+};
+
+struct Autorange {
+    struct RangeTime ranges[AUTORANGE_MAX_RANGES];
+    int              rangeCount;
+    unsigned         status;      // Unit bits and STATUS_AC/STATUS_DC of lastValid
+    int              rangeDigit;  // Range of lastValid
+    double           resolution;
+    struct timeval   lastValid;   // Last frame without overflow
+    long             pending;     // Overflow frames since lastValid
+    long             switches;    // Range changes by the autorange
+    long             lost;        // Overflow frames during the switches
+    double           switchTime;  // Seconds between the last frame of the old range and the first of the new one
+    double           latencyMax;
+};
+
+struct Calibration {
+    int             step;                        // Next step of the schedule
+    double          values[CAL_STABLE_SAMPLES];  // Last samples in one range, ring buffer
+    int             count;
+    unsigned        status;  // Unit bits and STATUS_AC/STATUS_DC of values[]
+    int             rangeDigit;
+    double          resolution;
+    bool            unchanged;  // The reading didn't change since the last step
+    double          last;       // Reading of the last step
+    int             measured;
+    int             passed;
+    struct CalRange ranges[CAL_MAX_RANGES];
+    int             rangeCount;
+    bool            reported;
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Devices. Each device argument is a tty, a capture file or a network device, optionally named with
+// name=path. With more than one device, the name is added to the sample outputs.
+//
+#define DEVICE_LOCAL   0  // tty or capture file
+#define DEVICE_TCP     1  // tcp://host:port
+#define DEVICE_RFC2217 2  // rfc2217://host:port
+#define DEVICE_RELAY   3  // relay://host:port, the "-f relay" stream of another vc830
+#define DEVICE_RELAYED 4  // A device of a relay:// stream, added when its first sample arrives
+
+union DeviceAddr {
+    struct sockaddr     sa;
+    struct sockaddr_in  in;
+    struct sockaddr_in6 in6;
+};
+
+struct Device {
+    const char        *name;  // The path if not named
+    const char        *path;
+    int                fd;    // -1 at the end of a capture file or while a network device is disconnected
+    struct PaketFramer framer;
+    bool               lineErrorMarks;  // enableLineErrorMarks() is active, see "-q"
+    long               frames;          // Decoded pakets
+    long               decodeErrors;    // Pakets rejected by decodeFS9922Paket()
+    struct Recorder    recorder;
+
+    // Network devices
+    int            type;  // DEVICE_xxx
+    char           host[BUFFER_LEN];
+    char           port[BUFFER_LEN];
+    bool           connecting;      // Non blocking connect() in progress, fd is polled for POLLOUT
+    struct timeval reconnectAt;     // Next connect while fd == -1
+    int            reconnectDelay;  // Seconds, doubled after each failure up to RECONNECT_MAX_SEC
+    long           connects;        // Connect attempts, selects the address if the host has several
+    long           reconnects;      // Connections lost after they were established
+    int            telnetState;     // Parser state of the RFC 2217 stream, see telnetFilter()
+
+    union DeviceAddr addrs[DEVICE_MAX_ADDRS];  // Resolved once, see connectDevice()
+    socklen_t        addrLens[DEVICE_MAX_ADDRS];
+    int              addrCount;                // 0 = not resolved yet
+
+    // Relay devices
+    byte          relayBuf[RELAY_RECORD_LEN];  // DEVICE_RELAY: incomplete record
+    int           relayLen;
+    int           relay;                       // DEVICE_RELAYED: index of the relay:// device
+    char          relayName[BUFFER_LEN];       // DEVICE_RELAYED: <relay name>/<device name>
+    unsigned long relaySeq;                    // DEVICE_RELAYED: last sequence number
+    long          lost;                        // DEVICE_RELAYED: samples missing in the sequence
+
+    int group;   // Fusion group, -1 = none
+    int member;  // Index in the group
+
+    struct Trend       trend;
+    struct Calibration calibration;
+    struct Autorange   autorange;
+
+    // REL reconstruction, "-b"
+    double   absolute;      // Last displayed value without REL
+    unsigned absoluteUnit;  // Unit bits of absolute, 0 = none
+    bool     rel;           // The last sample was REL
+    double   reference;     // Reference of the current REL, the last absolute value before it
+    bool     hasReference;
+
+    // HOLD interval, "-e"
+    bool           hold;
+    struct timeval holdStart;
+    struct timeval holdLast;
+    long           holdFrames;
+    double         holdValue;
+    bool           holdOverflow;
+    unsigned       holdUnit;  // Unit bits
+};
+
+struct Device devices[MAX_DEVICES];
+int           deviceCount  = 0;
+int           relayDevices = 0;  // relay:// devices, their devices are added to devices[] while running
+
+void addDevice(char *arg)
+{
+    if (deviceCount >= MAX_DEVICES) showUsageAndExit("Too many devices.");
+
+    struct Device *d = &devices[deviceCount++];
+    char          *eq = strchr(arg, '=');
+
+    d->name = arg;
+    d->path = arg;
+    if (eq) {
+        *eq     = '\0';
+        d->path = eq + 1;
+    }
+    if (!*d->name || !*d->path) showUsageAndExit("Wrong device name.");
+    d->fd    = -1;
+    d->group = -1;
+    framerReset(&d->framer);
+
+    const char *address = NULL;
+    if (strncmp(d->path, "tcp://", 6) == 0) {
+        d->type = DEVICE_TCP;
+        address = d->path + 6;
+    }
+    if (strncmp(d->path, "rfc2217://", 10) == 0) {
+        d->type = DEVICE_RFC2217;
+        address = d->path + 10;
+    }
+    if (strncmp(d->path, "relay://", 8) == 0) {
+        d->type = DEVICE_RELAY;
+        address = d->path + 8;
+        relayDevices++;
+    }
+    if (address == NULL) return;
+
+    // host:port, IPv6 addresses as [address]:port
+    const char *colon = strrchr(address, ':');
+    if (colon == NULL || !colon[1] || colon - address >= BUFFER_LEN) showUsageAndExit("Wrong network device, use tcp://host:port.");
+    const char *host    = address;
+    int         hostLen = colon - address;
+    if (hostLen >= 2 && host[0] == '[' && host[hostLen - 1] == ']') {
+        host++;
+        hostLen -= 2;
+    }
+    snprintf(d->host, sizeof(d->host), "%.*s", hostLen, host);
+    snprintf(d->port, sizeof(d->port), "%s", colon + 1);
+    if (!*d->host) showUsageAndExit("Wrong network device, use tcp://host:port.");
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Network devices, e.g. a serial server, ser2net or another vc830 for relay://. They are connected non
+// blocking from the main loop and reconnected after errors, the connection state is kept in struct Device.
+//
+// rfc2217:// is a telnet stream: vc830 requests the COM port option, sets 2400 baud 8N1 and switches
+// DTR on and RTS off like setRtsDtr(), the optical adapter is powered by DTR. Telnet commands of the
+// server are removed from the stream by telnetFilter().
+//
+#define TELNET_SE       240
+#define TELNET_SB       250
+#define TELNET_WILL     251
+#define TELNET_WONT     252
+#define TELNET_DO       253
+#define TELNET_DONT     254
+#define TELNET_IAC      255
+#define TELNET_BINARY   0
+#define TELNET_SGA      3   // Suppress go ahead
+#define TELNET_COM_PORT 44  // RFC 2217
+
+#define TELNET_STATE_DATA   0
+#define TELNET_STATE_IAC    1
+#define TELNET_STATE_WILL   2  // +0..3 for WILL, WONT, DO, DONT
+#define TELNET_STATE_SB     6
+#define TELNET_STATE_SB_IAC 7
+
+// Writes the RFC 2217 setup. The socket buffer is empty after the connect, the write is complete.
+void sendComPortSetup(int fd)
+{
+    // clang-format off
+    static const byte setup[] = {
+        TELNET_IAC, TELNET_WILL, TELNET_COM_PORT,
+        TELNET_IAC, TELNET_WILL, TELNET_BINARY,
+        TELNET_IAC, TELNET_DO, TELNET_BINARY,
+        TELNET_IAC, TELNET_DO, TELNET_SGA,
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 1, 0, 0, 2400 >> 8, 2400 & 0xff, TELNET_IAC, TELNET_SE,  // SET-BAUDRATE
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 2, 8, TELNET_IAC, TELNET_SE,                             // SET-DATASIZE
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 3, 1, TELNET_IAC, TELNET_SE,                             // SET-PARITY none
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 4, 1, TELNET_IAC, TELNET_SE,                             // SET-STOPSIZE 1
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 5, 1, TELNET_IAC, TELNET_SE,                             // SET-CONTROL no flow control
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 5, 8, TELNET_IAC, TELNET_SE,                             // SET-CONTROL DTR on
+        TELNET_IAC, TELNET_SB, TELNET_COM_PORT, 5, 12, TELNET_IAC, TELNET_SE,                            // SET-CONTROL RTS off
+    };
+    // clang-format on
+
+    if (write(fd, setup, sizeof(setup)) != sizeof(setup)) perror("RFC 2217 setup failed");
+}
+
+// Removes the telnet commands from the received bytes in place and returns the remaining data length.
+// Options requested by the server which are not used here are refused, the options requested by
+// sendComPortSetup() are not answered again.
+ssize_t telnetFilter(int device, byte *buf, ssize_t len)
+{
+    struct Device *d = &devices[device];
+    ssize_t        n = 0;
+
+    for (ssize_t i = 0; i < len; i++) {
+        byte b = buf[i];
+
+        switch (d->telnetState) {
+            case TELNET_STATE_DATA:
+                if (b == TELNET_IAC)
+                    d->telnetState = TELNET_STATE_IAC;
+                else
+                    buf[n++] = b;
+                break;
+
+            case TELNET_STATE_IAC:
+                d->telnetState = TELNET_STATE_DATA;
+                if (b == TELNET_IAC) buf[n++] = b;  // Escaped 0xff
+                if (b == TELNET_SB) d->telnetState = TELNET_STATE_SB;
+                if (b >= TELNET_WILL && b <= TELNET_DONT) d->telnetState = TELNET_STATE_WILL + b - TELNET_WILL;
+                break;
+
+            case TELNET_STATE_SB:  // Notifications of the server, e.g. the line state, are ignored
+                if (b == TELNET_IAC) d->telnetState = TELNET_STATE_SB_IAC;
+                break;
+
+            case TELNET_STATE_SB_IAC:
+                d->telnetState = b == TELNET_SE ? TELNET_STATE_DATA : TELNET_STATE_SB;
+                break;
+
+            default: {
+                int  command = TELNET_WILL + d->telnetState - TELNET_STATE_WILL;
+                bool used    = b == TELNET_BINARY || b == TELNET_SGA || b == TELNET_COM_PORT;
+                byte answer[3] = { TELNET_IAC, 0, b };
+
+                d->telnetState = TELNET_STATE_DATA;
+                if (used) break;
+                if (command == TELNET_WILL) answer[1] = TELNET_DONT;
+                if (command == TELNET_DO) answer[1] = TELNET_WONT;
+                if (answer[1] && write(d->fd, answer, sizeof(answer)) != sizeof(answer)) perror("Telnet answer failed");
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+void scheduleReconnect(int device, const char *reason)
+{
+    struct Device *d = &devices[device];
+
+    if (d->fd >= 0) close(d->fd);
+    d->fd         = -1;
+    d->connecting = false;
+    d->framer.idx = 0;  // The rest of the paket is lost
+
+    d->reconnectDelay = d->reconnectDelay == 0 ? 1 : d->reconnectDelay * 2;
+    if (d->reconnectDelay > RECONNECT_MAX_SEC) d->reconnectDelay = RECONNECT_MAX_SEC;
+    gettimeofday(&d->reconnectAt, NULL);
+    d->reconnectAt.tv_sec += d->reconnectDelay;
+
+    fprintf(stderr, "vc830: %s: %s, reconnect in %d s\n", d->path, reason, d->reconnectDelay);
+}
+
+void deviceConnected(int device)
+{
+    struct Device *d = &devices[device];
+
+    d->connecting     = false;
+    d->reconnectDelay = 0;
+    d->telnetState    = TELNET_STATE_DATA;
+    d->relayLen       = 0;
+    if (d->type == DEVICE_RFC2217) sendComPortSetup(d->fd);
+    if (d->type == DEVICE_RELAY && write(d->fd, "\n", 1) != 1) perror("Relay subscription failed");  // All samples
+    fprintf(stderr, "vc830: Connected to %s\n", d->path);
+}
+
+// Resolves the host of a network device. Returns false if it has no address.
+bool resolveDevice(int device)
+{
+    struct Device   *d = &devices[device];
+    struct addrinfo  hints;
+    struct addrinfo *list;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int err = getaddrinfo(d->host, d->port, &hints, &list);
+    if (err != 0) {
+        scheduleReconnect(device, gai_strerror(err));
+        return false;
+    }
+
+    for (struct addrinfo *a = list; a && d->addrCount < DEVICE_MAX_ADDRS; a = a->ai_next) {
+        if (a->ai_addrlen > sizeof(union DeviceAddr)) continue;
+        memcpy(&d->addrs[d->addrCount], a->ai_addr, a->ai_addrlen);
+        d->addrLens[d->addrCount++] = a->ai_addrlen;
+    }
+    freeaddrinfo(list);
+
+    if (d->addrCount == 0) scheduleReconnect(device, "No IPv4 or IPv6 address");
+    return d->addrCount > 0;
+}
+
+// Starts a non blocking connect. getaddrinfo() blocks all devices, so the host is only resolved until
+// it has an address, the reconnects use the same addresses.
+void connectDevice(int device)
+{
+    struct Device *d = &devices[device];
+
+    if (d->addrCount == 0 && !resolveDevice(device)) return;
+
+    // Hosts with several addresses (e.g. localhost with ::1 and 127.0.0.1) are tried in turn
+    int               i = d->connects++ % d->addrCount;
+    union DeviceAddr *a = &d->addrs[i];
+
+    d->fd = socket(a->sa.sa_family, SOCK_STREAM, 0);
+    if (d->fd >= 0) {
+        fcntl(d->fd, F_SETFL, O_NONBLOCK);
+        if (connect(d->fd, &a->sa, d->addrLens[i]) == 0)
+            deviceConnected(device);
+        else if (errno == EINPROGRESS)
+            d->connecting = true;
+        else
+            scheduleReconnect(device, strerror(errno));
+    }
+    else {
+        scheduleReconnect(device, strerror(errno));
+    }
+}
+
+// Called when the socket of a connecting device is writable
+void connectDone(int device)
+{
+    struct Device *d   = &devices[device];
+    int            err = 0;
+    socklen_t      len = sizeof(err);
+
+    if (getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+    if (err != 0)
+        scheduleReconnect(device, strerror(err));
+    else
+        deviceConnected(device);
+}
+
+// Connects the network devices which are due. Returns the poll() timeout until the next connect,
+// or timeout if it is earlier.
+int connectDueDevices(int timeout)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    for (int d = 0; d < deviceCount; d++) {
+        if (devices[d].type == DEVICE_LOCAL || devices[d].type == DEVICE_RELAYED || devices[d].fd >= 0) continue;
+
+        long long wait = -usecBetween(devices[d].reconnectAt, now) / 1000 + 1;  // ms, rounded up
+        if (wait <= 1 || wait > RECONNECT_MAX_SEC * 1000LL + 1) {  // Due, or the clock was set back
+            connectDevice(d);
+            if (devices[d].fd >= 0) continue;
+            wait = devices[d].reconnectDelay * 1000LL;
+        }
+        if (timeout < 0 || wait < timeout) timeout = wait;
+    }
+    return timeout;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Writes the flight recorder of a device into <dir>/<device>-<date>-<time>-<reason>.dat in the capture
+// format (raw bytes like capture_data.sh, usable as input for vc830) and the arrival time of each byte
+// into .times. The dump starts with the first paket after a gap, or after a \r\n if the ring has no gap,
+// so it can be decoded again.
+//
+void recorderDump(int device, const char *reason, struct timeval now)
+{
+    struct Device   *d = &devices[device];
+    struct Recorder *r = &d->recorder;
+    long             n = r->count < RECORDER_LEN ? r->count : RECORDER_LEN;
+    long             first = r->count - n;  // Oldest byte in the ring
+
+    if (n == 0) return;
+
+    // Arrival time of the oldest byte, backwards from the newest one
+    long long usec = r->lastAt.tv_sec * 1000000LL + r->lastAt.tv_usec;
+    for (long i = first + 1; i < r->count; i++) usec -= r->gapUsec[i % RECORDER_LEN];
+
+    long start = first;
+    for (long i = first + 1; i < r->count; i++) {
+        if (r->gapUsec[i % RECORDER_LEN] >= PAKET_GAP_USEC) {
+            start = i;
+            break;
+        }
+    }
+    for (long i = first + 2; i < r->count && start == first; i++) {  // No gap, after the \r\n at the end of a paket
+        if (r->bytes[(i - 2) % RECORDER_LEN] == '\r' && r->bytes[(i - 1) % RECORDER_LEN] == '\n') start = i;
+    }
+    for (long i = first + 1; i <= start; i++) usec += r->gapUsec[i % RECORDER_LEN];
+
+    // File names without the '/' of device names like bench3/dmm1
+    char      name[BUFFER_LEN];
+    char      date[BUFFER_LEN];
+    char      path[PATH_MAX];
+    struct tm tm;
+
+    snprintf(name, sizeof(name), "%s", d->name);
+    for (char *c = name; *c; c++) {
+        if (*c == '/' || *c == ' ') *c = '_';
+    }
+    localtime_r(&now.tv_sec, &tm);
+    strftime(date, sizeof(date), "%Y%m%d-%H%M%S", &tm);
+
+    snprintf(path, sizeof(path), "%s/%s-%s-%s.dat", recorderDir, name, date, reason);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    snprintf(path, sizeof(path), "%s/%s-%s-%s.times", recorderDir, name, date, reason);
+    int timesFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || timesFd < 0) {
+        perror("Flight recorder dump failed");
+        if (fd >= 0) close(fd);
+        if (timesFd >= 0) close(timesFd);
+        return;
+    }
+
+    for (long i = start; i < r->count; i++) {
+        int idx = i % RECORDER_LEN;
+        if (i > start) usec += r->gapUsec[idx];
+        if (write(fd, &r->bytes[idx], 1) != 1) break;
+        dprintf(timesFd, "%lld.%06lld %02x\n", usec / 1000000, usec % 1000000, r->bytes[idx]);
+    }
+    close(fd);
+    close(timesFd);
+
+    r->dumps++;
+    r->lastDumpAt = now;
+    fprintf(stderr, "vc830: Flight recorder of %s dumped to %s/%s-%s-%s.dat\n", d->name, recorderDir, name, date, reason);
+}
+
+// Automatic dumps on resyncs and decode error bursts, after the first good paket and rate limited
+void recorderTrigger(int device, const char *reason, struct timeval now)
+{
+    struct Device   *d = &devices[device];
+    struct Recorder *r = &d->recorder;
+
+    if (recorderDir == NULL || d->frames == 0) return;
+    if (r->dumps > 0 && usecBetween(r->lastDumpAt, now) < RECORDER_DUMP_INTERVAL_SEC * 1000000LL) return;
+    recorderDump(device, reason, now);
+}
+
+void recorderDecodeError(int device, struct timeval now)
+{
+    struct Recorder *r = &devices[device].recorder;
+
+    if (r->burstErrors == 0 || usecBetween(r->burstStart, now) > RECORDER_BURST_SEC * 1000000LL) {
+        r->burstStart  = now;
+        r->burstErrors = 0;
+    }
+    if (++r->burstErrors == RECORDER_BURST_ERRORS) recorderTrigger(device, "errors", now);
+}
+
+volatile sig_atomic_t recorderDumpRequested = 0;
+
+void recorderSignal(int sig) { recorderDumpRequested = 1; }
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Subscriptions of the clients connected to "-l port". Each client sends one filter line, which is
+// compiled into routing tables with one bit per client: per device, per unit and per flag. A sample
+// is routed with a few AND/OR operations per 64 clients, independent of the number of filter terms.
+//
+#define CLIENT_WORDS ((MAX_CLIENTS + 63) / 64)
+
+#define ROUTE_OVERFLOW  (1ull << 32)  // Routing flag in addition to the status bits
+#define ROUTE_FLAG_BITS 33
+
+struct RouteFlag {
+    const char        *name;
+    unsigned long long flags;
+};
+
+// clang-format off
+const struct RouteFlag routeFlags[] = {
+    { "auto",     STATUS_AUTO    },
+    { "dc",       STATUS_DC      },
+    { "ac",       STATUS_AC      },
+    { "rel",      STATUS_REL     },
+    { "hold",     STATUS_HOLD    },
+    { "max",      STATUS_MAX     },
+    { "min",      STATUS_MIN     },
+    { "bat",      STATUS_BAT     },
+    { "beep",     STATUS_BEEP    },
+    { "diode",    STATUS_DIODE   },
+    { "overflow", ROUTE_OVERFLOW },
+    { "alarms",   STATUS_BAT | ROUTE_OVERFLOW },
+
+    { NULL, 0 },
+};
+// clang-format on
+
+#define ROUTE_FLAG_MASK                                                                                         \
+    (STATUS_AUTO | STATUS_DC | STATUS_AC | STATUS_REL | STATUS_HOLD | STATUS_MAX | STATUS_MIN | STATUS_BAT | \
+     STATUS_BEEP | STATUS_DIODE | ROUTE_OVERFLOW)
+
+struct RouteUnit {
+    const char *name;
+    unsigned    unitStatus;  // SB4 bit
+};
+
+// clang-format off
+const struct RouteUnit routeUnits[] = {
+    { "V",   0x80 },
+    { "A",   0x40 },
+    { "Ω",   0x20 },
+    { "Ohm", 0x20 },
+    { "hFE", 0x10 },
+    { "Hz",  0x08 },
+    { "F",   0x04 },
+    { "°C",  0x02 },
+    { "C",   0x02 },
+    { "°F",  0x01 },
+
+    { NULL, 0 },
+};
+// clang-format on
+
+struct Client {
+    int  fd;          // -1 = unused
+    bool subscribed;  // Filter line received
+    char line[BUFFER_LEN];
+    int  lineLen;
+    char filter[BUFFER_LEN];  // Filter line, for devices added later by relay:// streams
+};
+
+struct Client clients[MAX_CLIENTS];
+int           listenFd = -1;
+
+unsigned long long routeByDevice[MAX_DEVICES][CLIENT_WORDS];
+unsigned long long routeByUnit[STATUS_UNITS + 1][CLIENT_WORDS];
+unsigned long long routeByFlag[ROUTE_FLAG_BITS][CLIENT_WORDS];
+unsigned long long routeAnyFlag[CLIENT_WORDS];  // Clients without flag filter
+long               routeDropped = 0;            // Samples not sent to slow clients
+
+#define CLIENT_BIT(c) (1ull << ((c) % 64))
+
+void routeSet(unsigned long long row[], int c) { row[c / 64] |= CLIENT_BIT(c); }
+void routeClear(unsigned long long row[], int c) { row[c / 64] &= ~CLIENT_BIT(c); }
+
+// Splits "a|b|c" and ORs the matching table entries. Returns false for an unknown name, then list
+// and flags are unchanged.
+bool parseRouteFlags(const char *list, unsigned long long *flags)
+{
+    char               names[BUFFER_LEN];
+    unsigned long long mask = 0;
+    char              *save;
+
+    snprintf(names, sizeof(names), "%s", list);
+    for (char *name = strtok_r(names, "|", &save); name; name = strtok_r(NULL, "|", &save)) {
+        const struct RouteFlag *f = routeFlags;
+        while (f->name && !strequal(f->name, name)) f++;
+        if (!f->name) return false;
+        mask |= f->flags;
+    }
+    *flags |= mask;
+    return true;
+}
+
+bool parseRouteUnits(const char *list, unsigned *units)
+{
+    char     names[BUFFER_LEN];
+    unsigned mask = 0;
+    char    *save;
+
+    snprintf(names, sizeof(names), "%s", list);
+    for (char *name = strtok_r(names, "|", &save); name; name = strtok_r(NULL, "|", &save)) {
+        const struct RouteUnit *u = routeUnits;
+        while (u->name && !strequal(u->name, name)) u++;
+        if (!u->name) return false;
+        mask |= u->unitStatus;
+    }
+    *units |= mask;
+    return true;
+}
+
+// True if the device patterns of the filter line match the device, or if there are none
+bool filterMatchesDevice(const char *filter, const char *name)
+{
+    char               line[BUFFER_LEN];
+    unsigned long long flags         = 0;
+    bool               devicePattern = false;
+    char              *save;
+
+    snprintf(line, sizeof(line), "%s", filter);
+    for (char *term = strtok_r(line, " ,\t", &save); term; term = strtok_r(NULL, " ,\t", &save)) {
+        if (strncmp(term, "unit=", 5) == 0 || strncmp(term, "flags=", 6) == 0 || parseRouteFlags(term, &flags)) continue;
+        if (fnmatch(term, name, 0) == 0) return true;
+        devicePattern = true;
+    }
+    return !devicePattern;
+}
+
+//
+// Compiles a filter line like "bench3/* unit=A alarms" for client c into the routing tables.
+// Terms are separated by space or comma:
+//      <pattern>               device names (glob, e.g. bench3/*)
+//      unit=<unit>[|<unit>]    V, A, Ω (Ohm), hFE, Hz, F, °C (C), °F
+//      flags=<flag>[|<flag>]   auto, dc, ac, rel, hold, max, min, bat, beep, diode, overflow, alarms (bat|overflow)
+//      <flag>                  same as flags=<flag>
+// Flag names take precedence over device names: a device named like a flag (e.g. dc) is only matched by
+// a glob, e.g. [d]c. Without a term of one kind all devices/units/flags match. A sample is sent if any of
+// the flags is set.
+// Return: NULL or an error message
+//
+const char *subscribe(int c, char *line)
+{
+    static char        error[BUFFER_LEN];
+    unsigned           units = 0;
+    unsigned long long flags = 0;
+    char              *save;
+
+    snprintf(clients[c].filter, sizeof(clients[c].filter), "%s", line);
+
+    for (char *term = strtok_r(line, " ,\t", &save); term; term = strtok_r(NULL, " ,\t", &save)) {
+        if (strncmp(term, "unit=", 5) == 0) {
+            if (!parseRouteUnits(term + 5, &units)) return "Unknown unit";
+            continue;
+        }
+        if (strncmp(term, "flags=", 6) == 0) {
+            if (!parseRouteFlags(term + 6, &flags)) return "Unknown flag";
+            continue;
+        }
+        if (parseRouteFlags(term, &flags)) continue;
+
+        bool found = relayDevices > 0;  // The devices of relay:// streams may come later
+        for (int d = 0; d < deviceCount && !found; d++) found = fnmatch(term, devices[d].name, 0) == 0;
+        if (!found) {
+            snprintf(error, sizeof(error), "No device matches %s", term);
+            return error;
+        }
+    }
+
+    for (int d = 0; d < deviceCount; d++) {
+        if (filterMatchesDevice(clients[c].filter, devices[d].name)) routeSet(routeByDevice[d], c);
+    }
+    for (unsigned u = 0; u <= STATUS_UNITS; u++) {
+        if (units == 0 || (u & units)) routeSet(routeByUnit[u], c);
+    }
+    if (flags == 0) routeSet(routeAnyFlag, c);
+    for (int b = 0; b < ROUTE_FLAG_BITS; b++) {
+        if (flags & (1ull << b)) routeSet(routeByFlag[b], c);
+    }
+    return NULL;
+}
+
+void unsubscribe(int c)
+{
+    for (int d = 0; d < deviceCount; d++) routeClear(routeByDevice[d], c);
+    for (unsigned u = 0; u <= STATUS_UNITS; u++) routeClear(routeByUnit[u], c);
+    for (int b = 0; b < ROUTE_FLAG_BITS; b++) routeClear(routeByFlag[b], c);
+    routeClear(routeAnyFlag, c);
+}
+
+// Adds a device of a relay:// stream to the existing subscriptions
+void subscribeNewDevice(int d)
+{
+    if (listenFd < 0) return;
+    for (int c = 0; c < MAX_CLIENTS; c++) {
+        if (clients[c].fd < 0 || !clients[c].subscribed) continue;
+        if (filterMatchesDevice(clients[c].filter, devices[d].name)) routeSet(routeByDevice[d], c);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+void closeClient(int c)
+{
+    unsubscribe(c);
+    close(clients[c].fd);
+    clients[c].fd = -1;
+}
+
+void sendToClient(int c, int device, const void *data, int len)
+{
+    ssize_t l = write(clients[c].fd, data, len);
+    if (l == len) return;
+
+    if (l < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        routeDropped++;  // Slow client, the sample is dropped
+        PROBE3(sink_drop, device, c, len);
+        return;
+    }
+    closeClient(c);  // Error or partial write, the stream can't be continued
+}
+
+// Sends the rendered sample to all clients with a matching subscription
+void routeSample(int device, unsigned status, bool overflow, const void *data, int len)
+{
+    unsigned long long flags = (status | (overflow ? ROUTE_OVERFLOW : 0)) & ROUTE_FLAG_MASK;
+
+    for (int w = 0; w < CLIENT_WORDS; w++) {
+        unsigned long long match = routeByDevice[device][w] & routeByUnit[status & STATUS_UNITS][w];
+        if (match == 0) continue;
+
+        unsigned long long flagMatch = routeAnyFlag[w];
+        for (unsigned long long f = flags; f; f &= f - 1) flagMatch |= routeByFlag[__builtin_ctzll(f)][w];
+
+        for (match &= flagMatch; match; match &= match - 1) sendToClient(w * 64 + __builtin_ctzll(match), device, data, len);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Markers, "-m file". A line on stdin, or "mark <text>" from a "-l" client after its filter line, is
+// printed as "marker" record. It has the time of the same clock as the samples, a running index and
+// the number of sample outputs before it, and it is sent to all subscribed clients. The markers are
+// also appended to the index file, the index goes on from the last marker in it:
+//
+//   <index>\t<epoch seconds>\t<outputs before>\t<text>
+//
+// So the samples of a test step are the sample outputs from its marker to the next one.
+//
+char  sampleBuffer[SAMPLE_BUFFER_LEN];  // See outputSample()
+FILE *sampleStream = NULL;
+
+FILE *markerFile   = NULL;
+long  markerCount   = 0;
+long  samplesOutput = 0;  // Outputs printed by outputSample(): samples, or statistics with "-a"
+char  markerLine[BUFFER_LEN];
+int   markerLineLen = 0;
+bool  markerStdin   = false;  // stdin is read for markers until its end
+
+void addMarker(const char *text, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct timeval       now;
+
+    gettimeofday(&now, NULL);
+    recordBegin(&r, "marker", now);
+    recordInt(&r, "index", ++markerCount);
+    recordInt(&r, "sample", samplesOutput);
+    recordString(&r, "text", text);
+
+    if (listenFd < 0) {
+        showRecord(&r, outputFormat, timeFormat);
+    }
+    else {
+        rewind(sampleStream);
+        output = sampleStream;
+        showRecord(&r, outputFormat, timeFormat);
+        fflush(sampleStream);
+        output = stdout;
+
+        long len = ftell(sampleStream);
+        fwrite(sampleBuffer, 1, len, stdout);
+        for (int c = 0; c < MAX_CLIENTS && len > 0; c++) {
+            if (clients[c].fd >= 0 && clients[c].subscribed) sendToClient(c, -1, sampleBuffer, len);
+        }
+    }
+    fflush(stdout);
+
+    fprintf(markerFile, "%ld\t%ld.%06ld\t%ld\t%s\n", markerCount, (long)now.tv_sec, (long)now.tv_usec, samplesOutput, text);
+    fflush(markerFile);
+}
+
+void openMarkerFile(const char *path)
+{
+    char line[BUFFER_LEN];
+    bool lineStart = true;
+
+    markerFile = fopen(path, "a+");  // Read from the start, written at the end
+    if (markerFile == NULL) exitWithError("Open marker file failed");
+
+    while (fgets(line, sizeof(line), markerFile)) {
+        if (lineStart && atol(line) > markerCount) markerCount = atol(line);
+        lineStart = strchr(line, '\n') != NULL;  // Longer lines are read in parts
+    }
+    markerStdin = true;
+}
+
+void readMarkers(const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    char buf[BUFFER_LEN];
+
+    ssize_t l = read(STDIN_FILENO, buf, sizeof(buf));
+    if (l < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (l <= 0) {
+        markerStdin = false;  // The samples are read on
+        return;
+    }
+
+    for (ssize_t i = 0; i < l; i++) {
+        if (buf[i] == '\r') continue;
+        if (buf[i] != '\n') {
+            if (markerLineLen < BUFFER_LEN - 1) markerLine[markerLineLen++] = buf[i];
+            continue;
+        }
+        markerLine[markerLineLen] = '\0';
+        markerLineLen             = 0;
+        addMarker(markerLine, outputFormat, timeFormat);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+void listenOn(int port)
+{
+    struct sockaddr_in addr;
+    int                on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) exitWithError("Socket failed");
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) exitWithError("Bind failed");
+    if (listen(listenFd, 16) != 0) exitWithError("Listen failed");
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+
+    for (int c = 0; c < MAX_CLIENTS; c++) clients[c].fd = -1;
+    signal(SIGPIPE, SIG_IGN);  // Closed clients are detected by write()
+}
+
+void acceptClient()
+{
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) return;
+
+    for (int c = 0; c < MAX_CLIENTS; c++) {
+        if (clients[c].fd < 0) {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            clients[c].fd         = fd;
+            clients[c].subscribed = false;
+            clients[c].lineLen    = 0;
+            return;
+        }
+    }
+    close(fd);  // Too many clients
+}
+
+// Reads the filter line, and with "-m" the marker lines after it. Other input is ignored.
+void readClient(int c, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct Client *cl = &clients[c];
+    char           buf[BUFFER_LEN];
+
+    ssize_t l = read(cl->fd, buf, sizeof(buf));
+    if (l < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (l <= 0) {
+        closeClient(c);
+        return;
+    }
+    if (cl->subscribed && markerFile == NULL) return;
+
+    for (ssize_t i = 0; i < l; i++) {
+        if (buf[i] == '\r') continue;
+        if (buf[i] != '\n') {
+            if (cl->lineLen < BUFFER_LEN - 1) cl->line[cl->lineLen++] = buf[i];
+            continue;
+        }
+        cl->line[cl->lineLen] = '\0';
+        cl->lineLen           = 0;
+
+        if (cl->subscribed) {
+            if (strncmp(cl->line, "mark ", 5) == 0) addMarker(cl->line + 5, outputFormat, timeFormat);
+            continue;
+        }
+
+        const char *error = subscribe(c, cl->line);
+        if (error) {
+            dprintf(cl->fd, "Error: %s\n", error);
+            closeClient(c);
+            return;
+        }
+        cl->subscribed = true;
+        if (markerFile == NULL) return;
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Fusion of redundant meters on the same point, "-g name=dev1,dev2,dev3[,median|mean][,tol=x[%]]".
+// The samples of the members are collected in rounds. A round is complete when all members sent a
+// sample, or FUSION_WINDOW_MSEC after its first sample, then a "fusion" record is printed.
+//
+// Members which differ from the median by more than the tolerance (default 1%, at least one digit of
+// the coarsest range) are outliers, overflows and samples with another unit too. If the majority
+// agrees, the outliers are not used. The fused value is the median or the mean weighted by the range
+// resolution (1 / resolution², so a finer range counts more). Members without a sample for
+// FUSION_DROPOUT_ROUNDS rounds are not waited for until they are back.
+//
+struct FusionMember {
+    const char *name;    // Device name
+    int         device;  // -1 until a device with the name exists (relay://)
+    bool        fresh;   // Sample in the current round
+    bool        overflow;
+    double      value;
+    double      resolution;
+    char        unit[BUFFER_LEN];
+    int         missedRounds;
+};
+
+struct FusionGroup {
+    const char         *name;
+    bool                median;
+    double              tolerance;  // SI base unit, or % of the median if relative
+    bool                relative;
+    int                 memberCount;
+    struct FusionMember members[GROUP_MAX_MEMBERS];
+    bool                roundOpen;
+    struct timeval      roundStart;  // Arrival of the first sample of the round
+    struct timeval      roundTime;   // Receive time of the first sample, used as record timestamp
+};
+
+struct FusionGroup groups[MAX_GROUPS];
+int                groupCount = 0;
+
+void addGroup(char *arg)
+{
+    if (groupCount >= MAX_GROUPS) showUsageAndExit("Too many groups.");
+
+    struct FusionGroup *g  = &groups[groupCount++];
+    char               *eq = strchr(arg, '=');
+    char               *save;
+
+    if (eq == NULL || eq == arg) showUsageAndExit("Wrong group, use -g name=device,device,...");
+    *eq          = '\0';
+    g->name      = arg;
+    g->median    = true;
+    g->tolerance = 1;
+    g->relative  = true;
+
+    for (char *term = strtok_r(eq + 1, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+        if (strequal(term, "median") || strequal(term, "mean")) {
+            g->median = strequal(term, "median");
+            continue;
+        }
+        if (strncmp(term, "tol=", 4) == 0) {
+            char *end;
+            g->tolerance = strtod(term + 4, &end);
+            g->relative  = *end == '%';
+            if (end == term + 4 || (*end && !g->relative) || (g->relative && end[1]) || g->tolerance < 0) showUsageAndExit("Wrong group tolerance.");
+            continue;
+        }
+        if (g->memberCount >= GROUP_MAX_MEMBERS) showUsageAndExit("Too many group members.");
+        g->members[g->memberCount].name     = term;
+        g->members[g->memberCount++].device = -1;
+    }
+    if (g->memberCount < 2) showUsageAndExit("A group needs at least two devices.");
+}
+
+// Adds the device to the group with its name. A device can be in one group only.
+void groupAttach(int device)
+{
+    struct Device *d = &devices[device];
+
+    for (int g = 0; g < groupCount && d->group < 0; g++) {
+        for (int m = 0; m < groups[g].memberCount; m++) {
+            struct FusionMember *fm = &groups[g].members[m];
+            if (fm->device >= 0 || !strequal(fm->name, d->name)) continue;
+            fm->device = device;
+            d->group   = g;
+            d->member  = m;
+            break;
+        }
+    }
+}
+
+// Appends name to a comma separated list
+void appendName(char *list, const char *name)
+{
+    size_t len = strlen(list);
+    snprintf(list + len, BUFFER_LEN - len, "%s%s", len ? "," : "", name);
+}
+
+// Outputs the fusion record of the current round and starts the next one. Return value like showData().
+int fusionRound(struct FusionGroup *g, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct FusionMember *m;
+    const char          *unit  = NULL;
+    int                  votes = 0;
+
+    // The unit of the most members is used
+    for (int i = 0; i < g->memberCount; i++) {
+        m = &g->members[i];
+        if (!m->fresh || m->overflow) continue;
+        int n = 0;
+        for (int j = 0; j < g->memberCount; j++) n += g->members[j].fresh && !g->members[j].overflow && strequal(g->members[j].unit, m->unit);
+        if (n > votes) {
+            votes = n;
+            unit  = m->unit;
+        }
+    }
+
+    // Median and tolerance of the members with this unit
+    double values[GROUP_MAX_MEMBERS];
+    double resolution = 0;
+    int    count      = 0;
+    for (int i = 0; i < g->memberCount; i++) {
+        m = &g->members[i];
+        if (!m->fresh || m->overflow || !strequal(m->unit, unit ? unit : "")) continue;
+
+        int j = count++;
+        for (; j > 0 && values[j - 1] > m->value; j--) values[j] = values[j - 1];
+        values[j] = m->value;
+        if (m->resolution > resolution) resolution = m->resolution;
+    }
+    double median    = count == 0 ? 0 : count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+    double tolerance = g->relative ? fabs(median) * g->tolerance / 100 : g->tolerance;
+    if (tolerance < resolution) tolerance = resolution;
+
+    int agreeing = 0;
+    for (int i = 0; i < g->memberCount; i++) {
+        m = &g->members[i];
+        if (m->fresh && !m->overflow && strequal(m->unit, unit ? unit : "") && fabs(m->value - median) <= tolerance) agreeing++;
+    }
+    bool majority = agreeing * 2 > count;
+
+    // Fused value of the used members
+    char   outliers[BUFFER_LEN] = "";
+    char   missing[BUFFER_LEN]  = "";
+    double used[GROUP_MAX_MEMBERS];
+    double weightSum = 0;
+    double sum       = 0;
+    int    usedCount = 0;
+    for (int i = 0; i < g->memberCount; i++) {
+        m = &g->members[i];
+        if (!m->fresh) {
+            appendName(missing, m->name);
+            if (++m->missedRounds == FUSION_DROPOUT_ROUNDS) fprintf(stderr, "vc830: %s of group %s dropped out\n", m->name, g->name);
+            continue;
+        }
+        bool valid = !m->overflow && strequal(m->unit, unit ? unit : "");
+        bool agree = valid && fabs(m->value - median) <= tolerance;
+        if (!agree) appendName(outliers, m->name);
+        if (!valid || (!agree && majority)) continue;
+
+        int j = usedCount++;
+        for (; j > 0 && used[j - 1] > m->value; j--) used[j] = used[j - 1];
+        used[j] = m->value;
+
+        double weight = m->resolution > 0 ? 1 / (m->resolution * m->resolution) : 1;
+        weightSum += weight;
+        sum += weight * m->value;
+    }
+
+    recordBegin(&r, "fusion", g->roundTime);
+    recordString(&r, "group", g->name);
+    recordString(&r, "unit", unit ? unit : "");
+    recordString(&r, "method", g->median ? "median" : "mean");
+    if (usedCount > 0) {
+        double value = usedCount % 2 ? used[usedCount / 2] : (used[usedCount / 2 - 1] + used[usedCount / 2]) / 2;
+        recordDouble(&r, "value", g->median ? value : sum / weightSum);
+        recordDouble(&r, "spread", values[count - 1] - values[0]);
+    }
+    recordInt(&r, "members", g->memberCount);
+    recordInt(&r, "used", usedCount);
+    recordString(&r, "outliers", outliers);
+    recordString(&r, "missing", missing);
+    recordBool(&r, "disagreement", *outliers != '\0');
+
+    for (int i = 0; i < g->memberCount; i++) g->members[i].fresh = false;
+    g->roundOpen = false;
+
+    return showRecord(&r, outputFormat, timeFormat);
+}
+
+// Adds the sample of a group member. Returns the number of printed records.
+int fusionSample(int device, struct Vc830 *vc830Data, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct FusionGroup  *g   = &groups[devices[device].group];
+    struct FusionMember *m   = &g->members[devices[device].member];
+    int                  ret = 0;
+
+    if (m->fresh) ret += fusionRound(g, outputFormat, timeFormat);  // Second sample of the member, the round is over
+    if (m->missedRounds >= FUSION_DROPOUT_ROUNDS) fprintf(stderr, "vc830: %s of group %s is back\n", m->name, g->name);
+
+    m->fresh        = true;
+    m->missedRounds = 0;
+    m->overflow     = vc830Data->overflow;
+    m->value        = vc830Data->siValue;
+    m->resolution   = vc830Data->resolution;
+    snprintf(m->unit, sizeof(m->unit), "%s", vc830Data->unit);
+
+    if (!g->roundOpen) {
+        g->roundOpen = true;
+        g->roundTime = vc830Data->receivedAt;
+        gettimeofday(&g->roundStart, NULL);
+    }
+
+    for (int i = 0; i < g->memberCount; i++) {
+        if (!g->members[i].fresh && g->members[i].missedRounds < FUSION_DROPOUT_ROUNDS) return ret;
+    }
+    return ret + fusionRound(g, outputFormat, timeFormat);
+}
+
+// Completes the rounds which waited FUSION_WINDOW_MSEC. Returns the number of printed records.
+int fusionFlush(const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct timeval now;
+    int            ret = 0;
+
+    gettimeofday(&now, NULL);
+    for (int g = 0; g < groupCount; g++) {
+        if (groups[g].roundOpen && usecBetween(groups[g].roundStart, now) >= FUSION_WINDOW_MSEC * 1000LL) ret += fusionRound(&groups[g], outputFormat, timeFormat);
+    }
+    return ret;
+}
+
+// poll() timeout until the next open round is complete, or timeout if it is earlier
+int fusionTimeout(int timeout)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    for (int g = 0; g < groupCount; g++) {
+        if (!groups[g].roundOpen) continue;
+        long long wait = FUSION_WINDOW_MSEC - usecBetween(groups[g].roundStart, now) / 1000 + 1;  // ms, rounded up
+        if (wait < 0) wait = 0;
+        if (wait > FUSION_WINDOW_MSEC + 1) wait = FUSION_WINDOW_MSEC + 1;  // The clock was set back
+        if (timeout < 0 || wait < timeout) timeout = wait;
+    }
+    return timeout;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Trend, "-r seconds[,threshold]". After each sample a "trend" record with the linear fit (slope in SI
+// unit per second) and the exponential fit y = A * e^(expRate * t) over the last seconds is printed,
+// with the coefficient of determination (r2) of each. With a threshold, the projected seconds until
+// the fit crosses it are added, if it is crossed in the future.
+//
+double trendWindow = 0;  // Seconds, 0 = off
+double trendThreshold;
+bool   trendHasThreshold = false;
+
+void trendAdd(struct TrendSums *s, const struct TrendSums *x)
+{
+    s->n += x->n;
+    s->t += x->t;
+    s->y += x->y;
+    s->tt += x->tt;
+    s->ty += x->ty;
+    s->yy += x->yy;
+    s->positive += x->positive;
+    s->negative += x->negative;
+    s->ly += x->ly;
+    s->tly += x->tly;
+    s->lyly += x->lyly;
+}
+
+// Least squares line y = intercept + slope * t. Returns false if the times don't differ.
+bool linearFit(double n, double t, double y, double tt, double ty, double yy, double *slope, double *intercept,
+               double *r2)
+{
+    double tVar  = n * tt - t * t;
+    double yVar  = n * yy - y * y;
+    double tyCov = n * ty - t * y;
+
+    if (n < 2 || tVar <= 0) return false;
+    *slope     = tyCov / tVar;
+    *intercept = (y - *slope * t) / n;
+    *r2        = yVar > 0 ? tyCov * tyCov / (tVar * yVar) : 1;  // Constant values are fitted exactly
+    return true;
+}
+
+int trendSample(int device, struct Vc830 *vc830Data, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct Trend        *tr    = &devices[device].trend;
+    double               width = trendWindow / TREND_BUCKETS;
+
+    if (vc830Data->overflow) return 0;
+
+    // Seconds since the origin. A new unit or a clock set back before the current bucket restarts the trend.
+    double t = (vc830Data->receivedAt.tv_sec - tr->origin.tv_sec) + (vc830Data->receivedAt.tv_usec - tr->origin.tv_usec) / 1e6;
+    if (tr->origin.tv_sec == 0 || (vc830Data->status & STATUS_UNITS) != tr->unit || t < tr->bucket * width) {
+        memset(tr, 0, sizeof(*tr));
+        tr->origin = vc830Data->receivedAt;
+        tr->unit   = vc830Data->status & STATUS_UNITS;
+        t          = 0;
+    }
+
+    // Slide the window. The window is summed again from the buckets, so no rounding errors accumulate.
+    long bucket = t / width;
+    if (bucket > tr->bucket) {
+        if (bucket - tr->bucket > TREND_BUCKETS) tr->bucket = bucket - TREND_BUCKETS;  // Long gap, all buckets are left
+        for (; tr->bucket < bucket; tr->bucket++) memset(&tr->buckets[(tr->bucket + 1) % TREND_BUCKETS], 0, sizeof(struct TrendSums));
+
+        memset(&tr->window, 0, sizeof(tr->window));
+        for (int b = 0; b < TREND_BUCKETS; b++) trendAdd(&tr->window, &tr->buckets[b]);
+    }
+
+    double           y  = vc830Data->siValue;
+    double           ly = y != 0 ? log(fabs(y)) : 0;
+    struct TrendSums x  = { 1, t, y, t * t, t * y, y * y, y > 0, y < 0, ly, t * ly, ly * ly };
+    trendAdd(&tr->buckets[bucket % TREND_BUCKETS], &x);
+    trendAdd(&tr->window, &x);
+
+    struct TrendSums *w = &tr->window;
+    double            slope, intercept, r2;
+    if (w->n < 3 || !linearFit(w->n, w->t, w->y, w->tt, w->ty, w->yy, &slope, &intercept, &r2)) return 0;
+
+    recordBegin(&r, "trend", vc830Data->receivedAt);
+    recordString(&r, "device", devices[device].name);
+    recordString(&r, "unit", vc830Data->unit);
+    recordInt(&r, "samples", w->n);
+    recordDouble(&r, "slope", slope);
+    recordDouble(&r, "r2", r2);
+
+    double expRate = 0, expIntercept = 0, expR2 = 0;
+    double sign   = w->positive == w->n ? 1 : -1;
+    bool   expFit = (w->positive == w->n || w->negative == w->n) &&
+                  linearFit(w->n, w->t, w->ly, w->tt, w->tly, w->lyly, &expRate, &expIntercept, &expR2);
+    if (expFit) {
+        recordDouble(&r, "expRate", expRate);
+        recordDouble(&r, "expR2", expR2);
+    }
+
+    if (trendHasThreshold) {
+        recordDouble(&r, "threshold", trendThreshold);
+        double crossing = slope != 0 ? (trendThreshold - intercept) / slope - t : -1;
+        if (crossing > 0) recordDouble(&r, "timeToThreshold", crossing);
+
+        double ratio = trendThreshold * sign;  // |threshold|, if it has the sign of the values
+        if (expFit && expRate != 0 && ratio > 0) {
+            crossing = (log(ratio) - expIntercept) / expRate - t;
+            if (crossing > 0) recordDouble(&r, "expTimeToThreshold", crossing);
+        }
+    }
+
+    return showRecord(&r, outputFormat, timeFormat);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Calibration verification, "-s schedule". The schedule file has one setpoint per line, # starts a comment:
+//
+//   <setpoint> <unit> [AC|DC] [<x>%] [<n>]       e.g. "1.9 V DC 0.5% 3"
+//
+// The setpoint is in the SI base unit, the tolerance is x% of the setpoint plus n digits of the range.
+// Each device steps through the schedule. A step is taken when the last CAL_STABLE_SAMPLES samples of
+// one range are within CAL_STABLE_DIGITS digits and their mean is near the setpoint, then a
+// "calibration" record with the error is printed. The reading must change before the next step is
+// taken, so a setpoint is not measured twice while the calibrator is set to the next one. After the
+// last step, or at the end of the run, a "calibrationRange" record per range (unit, AC/DC and the range
+// digit buf[6] of the paket) and a "calibrationResult" record are printed.
+//
+struct CalStep {
+    double      setpoint;
+    unsigned    unit;  // SB4 bit
+    const char *unitName;
+    unsigned    mode;  // STATUS_AC, STATUS_DC or 0 for both
+    double      percent;
+    double      digits;
+};
+
+struct CalStep calSteps[CAL_MAX_STEPS];
+int            calStepCount = 0;
+
+void loadSchedule(const char *path)
+{
+    static char message[BUFFER_LEN];
+    char        line[BUFFER_LEN];
+    int         lineNumber = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) exitWithError("Open schedule file failed");
+
+    while (fgets(line, sizeof(line), f)) {
+        char *save, *end;
+
+        lineNumber++;
+        snprintf(message, sizeof(message), "Wrong schedule line %d.", lineNumber);
+        if (strchr(line, '#')) *strchr(line, '#') = '\0';
+
+        char *term = strtok_r(line, " \t\r\n", &save);
+        if (term == NULL) continue;
+        if (calStepCount >= CAL_MAX_STEPS) showUsageAndExit("Too many setpoints in the schedule.");
+
+        struct CalStep *step = &calSteps[calStepCount++];
+        step->setpoint       = strtod(term, &end);
+        step->percent        = CAL_TOLERANCE_PERCENT;
+        step->digits         = CAL_TOLERANCE_DIGITS;
+        if (end == term || *end) showUsageAndExit(message);
+
+        term = strtok_r(NULL, " \t\r\n", &save);
+        for (const struct RouteUnit *u = routeUnits; term && u->name; u++) {
+            if (!strequal(u->name, term)) continue;
+            step->unit     = u->unitStatus;
+            step->unitName = u->name;
+        }
+        if (step->unit == 0) showUsageAndExit(message);
+
+        while ((term = strtok_r(NULL, " \t\r\n", &save))) {
+            if (strequal(term, "AC") || strequal(term, "DC")) {
+                step->mode = strequal(term, "AC") ? STATUS_AC : STATUS_DC;
+                continue;
+            }
+            double x = strtod(term, &end);
+            if (end == term || x < 0 || (*end && !strequal(end, "%"))) showUsageAndExit(message);
+            if (*end)
+                step->percent = x;
+            else
+                step->digits = x;
+        }
+    }
+    fclose(f);
+    if (calStepCount == 0) showUsageAndExit("The schedule has no setpoints.");
+}
+
+// Full scale of the range with the resolution, e.g. "6 V"
+const char *rangeName(double resolution, const char *unit)
+{
+    static char name[BUFFER_LEN];
+
+    snprintf(name, sizeof(name), "%g %s", RANGE_COUNTS * resolution, unit);
+    return name;
+}
+
+const char *unitNameOf(unsigned status)
+{
+    for (const struct RouteUnit *u = routeUnits; u->name; u++) {
+        if (u->unitStatus == (status & STATUS_UNITS)) return u->name;
+    }
+    return "";
+}
+
+// Prints the range and result records of the device once
+void calibrationReport(int device, struct timeval now, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct Calibration  *cal = &devices[device].calibration;
+
+    if (cal->reported) return;
+    cal->reported = true;
+
+    for (int i = 0; i < cal->rangeCount; i++) {
+        struct CalRange *range = &cal->ranges[i];
+        recordBegin(&r, "calibrationRange", now);
+        recordString(&r, "device", devices[device].name);
+        recordString(&r, "unit", unitNameOf(range->status));
+        if (*modeName(range->status)) recordString(&r, "mode", modeName(range->status));
+        recordString(&r, "range", rangeName(range->resolution, unitNameOf(range->status)));
+        recordInt(&r, "steps", range->steps);
+        recordInt(&r, "passed", range->passed);
+        recordDouble(&r, "worst", range->worst);
+        recordBool(&r, "pass", range->passed == range->steps);
+        showRecord(&r, outputFormat, timeFormat);
+    }
 
-    lastSpeechData->batteryWarning = checkSpeechBool(lastSpeechData->batteryWarning, vc830Data->batteryWarning, "BAT");
+    recordBegin(&r, "calibrationResult", now);
+    recordString(&r, "device", devices[device].name);
+    recordInt(&r, "steps", calStepCount);
+    recordInt(&r, "measured", cal->measured);
+    recordInt(&r, "passed", cal->passed);
+    recordInt(&r, "missing", calStepCount - cal->measured);
+    recordBool(&r, "pass", cal->passed == calStepCount);
+    showRecord(&r, outputFormat, timeFormat);
+}
 
-    checkSpeechStr(lastSpeechData->info, vc830Data->info, "AUTO");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC REL");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC HOLD");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "DC");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC REL");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC HOLD");
-    checkSpeechStr(lastSpeechData->mode, vc830Data->mode, "AC");
+// Counts the step in its range. Ranges beyond CAL_MAX_RANGES are only counted in the result.
+void calibrationRangeAdd(struct Calibration *cal, bool pass, double ratio)
+{
+    struct CalRange *range = NULL;
 
-    if (!strequal(lastSpeechData->formatedValue, vc830Data->formatedValue)) {
+    for (int i = 0; i < cal->rangeCount && range == NULL; i++) {
+        struct CalRange *x = &cal->ranges[i];
+        if (x->status == cal->status && x->rangeDigit == cal->rangeDigit && x->resolution == cal->resolution) range = x;
+    }
+    if (range == NULL) {
+        if (cal->rangeCount >= CAL_MAX_RANGES) return;
+        range             = &cal->ranges[cal->rangeCount++];
+        range->status     = cal->status;
+        range->rangeDigit = cal->rangeDigit;
+        range->resolution = cal->resolution;
+    }
+    range->steps++;
+    range->passed += pass;
+    if (ratio > range->worst) range->worst = ratio;
+}
 
-        char   buf[BUFFER_LEN];
-        double vSpeach = atof(vc830Data->value) * (vc830Data->sign == '-' ? -1 : 1);
+int calibrationSample(int device, struct Vc830 *vc830Data, const byte *paket, const struct OutputFormat *outputFormat,
+                      const char *timeFormat)
+{
+    static struct Record r;
+    struct Calibration  *cal    = &devices[device].calibration;
+    unsigned             status = vc830Data->status & (STATUS_UNITS | STATUS_AC | STATUS_DC);
+    double               digit  = vc830Data->resolution;
+    double               v      = vc830Data->siValue;
+
+    if (cal->step >= calStepCount) return 0;
+
+    // HOLD, REL, MIN and MAX don't show the input, a new range or unit restarts the stability check
+    if (vc830Data->overflow || (vc830Data->status & (STATUS_HOLD | STATUS_REL | STATUS_MIN | STATUS_MAX))) {
+        cal->count     = 0;
+        cal->unchanged = false;
+        return 0;
+    }
+    if (status != cal->status || paket[6] != cal->rangeDigit || digit != cal->resolution) {
+        cal->count      = 0;
+        cal->unchanged  = false;
+        cal->status     = status;
+        cal->rangeDigit = paket[6];
+        cal->resolution = digit;
+    }
+    if (fabs(v - cal->last) > CAL_STABLE_DIGITS * digit) cal->unchanged = false;
 
-        // Patch for german outout... (the ugly way..., but my locale is normally "en"...)
-        if (strchr(vc830Data->value, '.')) {
+    cal->values[cal->count++ % CAL_STABLE_SAMPLES] = v;
+    if (cal->count < CAL_STABLE_SAMPLES || cal->unchanged) return 0;
 
-            // We limit the the spoken output to one digit after komma
-            snprintf(buf, sizeof(buf), "%1.1f", vSpeach);
+    double min = v, max = v, sum = 0;
+    for (int i = 0; i < CAL_STABLE_SAMPLES; i++) {
+        if (cal->values[i] < min) min = cal->values[i];
+        if (cal->values[i] > max) max = cal->values[i];
+        sum += cal->values[i];
+    }
+    double          mean = sum / CAL_STABLE_SAMPLES;
+    struct CalStep *step = &calSteps[cal->step];
+    if (max - min > CAL_STABLE_DIGITS * digit) return 0;
+    if ((status & STATUS_UNITS) != step->unit || (step->mode && !(status & step->mode))) return 0;
+    if (fabs(mean - step->setpoint) > fabs(step->setpoint) * CAL_CAPTURE_PERCENT / 100 + CAL_CAPTURE_DIGITS * digit) return 0;
+
+    double error = mean - step->setpoint;
+    double limit = fabs(step->setpoint) * step->percent / 100 + step->digits * digit;
+    bool   pass  = fabs(error) <= limit;
+    calibrationRangeAdd(cal, pass, limit > 0 ? fabs(error) / limit : 0);
+    cal->measured++;
+    cal->passed += pass;
+
+    recordBegin(&r, "calibration", vc830Data->receivedAt);
+    recordString(&r, "device", devices[device].name);
+    recordInt(&r, "step", cal->step + 1);
+    recordDouble(&r, "setpoint", step->setpoint);
+    recordString(&r, "unit", step->unitName);
+    if (*modeName(status)) recordString(&r, "mode", modeName(status));
+    recordString(&r, "range", rangeName(digit, step->unitName));
+    recordDouble(&r, "value", mean);
+    recordDouble(&r, "error", error);
+    if (step->setpoint != 0) recordDouble(&r, "errorPercent", error / fabs(step->setpoint) * 100);
+    recordDouble(&r, "limit", limit);
+    recordBool(&r, "pass", pass);
+    showRecord(&r, outputFormat, timeFormat);
+
+    cal->step++;
+    cal->count     = 0;
+    cal->unchanged = true;
+    cal->last      = mean;
+    if (cal->step == calStepCount) calibrationReport(device, vc830Data->receivedAt, outputFormat, timeFormat);
+    return 0;
+}
 
-            char *k = strchr(buf, '.');
-            if (k) {
-                *k = ',';
+// The run ends when all devices are through the schedule. Devices of relay:// streams can still be added.
+bool calibrationDone()
+{
+    for (int d = 0; d < deviceCount; d++) {
+        if (devices[d].type != DEVICE_RELAY && devices[d].calibration.step < calStepCount) return false;
+    }
+    return relayDevices == 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Autorange report, "-u seconds". For each device the time and the frames per range (unit, AC/DC,
+// range digit buf[6] and resolution) and the number of frames with the bar graph near the switch to the
+// next range are counted. A change of the range with AUTO is a switch. Its latency is the time from
+// the last frame of the old range to the first of the new one, the overflow frames in between are lost.
+// Every "-u" seconds and at the end an "autorange" record per device and a "rangeTime" record per range
+// are printed, counted since the start. A device with AUTORANGE_HUNT_PER_MIN or more switches per
+// minute is hunting between the ranges, a manual range gives more valid samples and a fixed resolution.
+//
+long autorangeReport = 0;  // Seconds, 0 = off
+
+void autorangeSample(int device, struct Vc830 *vc830Data, const byte *paket)
+{
+    struct Autorange *a      = &devices[device].autorange;
+    unsigned          status = vc830Data->status & (STATUS_UNITS | STATUS_AC | STATUS_DC);
+    struct RangeTime *range  = NULL;
+    int               r;
+
+    if (vc830Data->overflow) {
+        a->pending++;
+        return;
+    }
+
+    for (r = 0; r < a->rangeCount; r++) {
+        struct RangeTime *x = &a->ranges[r];
+        if (x->status == status && x->rangeDigit == paket[6] && x->resolution == vc830Data->resolution) break;
+    }
+    if (r == a->rangeCount && r < AUTORANGE_MAX_RANGES) {
+        a->rangeCount++;
+        a->ranges[r].status     = status;
+        a->ranges[r].rangeDigit = paket[6];
+        a->ranges[r].resolution = vc830Data->resolution;
+    }
+    if (r < a->rangeCount) range = &a->ranges[r];
+
+    // The time since the last frame belongs to its range, or to the switch
+    if (a->lastValid.tv_sec != 0) {
+        double dt = usecBetween(a->lastValid, vc830Data->receivedAt) / 1e6;
+        if (dt >= 0 && dt <= AUTORANGE_GAP_SEC) {
+            bool sameRange = status == a->status && paket[6] == a->rangeDigit && vc830Data->resolution == a->resolution;
+            if (sameRange) {
+                if (range) range->seconds += dt;
+            }
+            else if (status == a->status && vc830Data->autoRangeActive) {
+                a->switches++;
+                a->lost += a->pending;
+                a->switchTime += dt;
+                if (dt > a->latencyMax) a->latencyMax = dt;
             }
         }
-        else {
-            snprintf(buf, sizeof(buf), "%1.0f", vSpeach);
+    }
+
+    if (range) {
+        range->frames++;
+        if (vc830Data->barGraph >= AUTORANGE_NEAR_TOP) range->nearTop++;
+    }
+    a->status     = status;
+    a->rangeDigit = paket[6];
+    a->resolution = vc830Data->resolution;
+    a->lastValid  = vc830Data->receivedAt;
+    a->pending    = 0;
+}
+
+void showAutorangeReport(int device, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct Autorange    *a      = &devices[device].autorange;
+    double               total  = a->switchTime;
+    long                 frames = 0;
+    struct timeval       now;
+
+    if (devices[device].type == DEVICE_RELAY) return;
+    gettimeofday(&now, NULL);
+    for (int i = 0; i < a->rangeCount; i++) {
+        total += a->ranges[i].seconds;
+        frames += a->ranges[i].frames;
+    }
+
+    recordBegin(&r, "autorange", now);
+    recordString(&r, "device", devices[device].name);
+    recordInt(&r, "frames", frames);
+    recordDouble(&r, "seconds", total);
+    recordInt(&r, "switches", a->switches);
+    if (total > 0) recordDouble(&r, "switchesPerMinute", a->switches * 60 / total);
+    if (a->switches > 0) {
+        recordDouble(&r, "latencyMean", a->switchTime / a->switches);
+        recordDouble(&r, "latencyMax", a->latencyMax);
+    }
+    recordInt(&r, "lost", a->lost);
+    recordBool(&r, "hunting", total > 0 && a->switches * 60 / total >= AUTORANGE_HUNT_PER_MIN);
+    showRecord(&r, outputFormat, timeFormat);
+
+    for (int i = 0; i < a->rangeCount; i++) {
+        struct RangeTime *range = &a->ranges[i];
+        recordBegin(&r, "rangeTime", now);
+        recordString(&r, "device", devices[device].name);
+        recordString(&r, "unit", unitNameOf(range->status));
+        if (*modeName(range->status)) recordString(&r, "mode", modeName(range->status));
+        recordString(&r, "range", rangeName(range->resolution, unitNameOf(range->status)));
+        recordInt(&r, "frames", range->frames);
+        recordDouble(&r, "seconds", range->seconds);
+        if (total > 0) recordDouble(&r, "share", range->seconds * 100 / total);
+        recordInt(&r, "nearTop", range->nearTop);
+        showRecord(&r, outputFormat, timeFormat);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// REL reconstruction, "-b". The meter takes the displayed value as reference when REL is pressed and
+// shows the difference to it. The last value before the REL sample is used as reference, so the absolute
+// value is the relative value plus the reference. The first paket with REL can still show the reference
+// itself, if it is closer to the last value than to 0, it is taken as reference. A reference is only
+// known if REL was pressed while the device was read and the unit didn't change since. With "-a" the
+// statistics use the absolute values, REL samples with an unknown reference are only counted.
+//
+void relSample(int device, struct Vc830 *vc830Data)
+{
+    struct Device *d    = &devices[device];
+    unsigned       unit = vc830Data->status & STATUS_UNITS;
+
+    sampleHasAbsolute = false;
+    if (!(vc830Data->status & STATUS_REL)) {
+        if (!vc830Data->overflow) {
+            d->absolute     = vc830Data->siValue;
+            d->absoluteUnit = unit;
         }
+        d->rel = false;
+        return;
+    }
 
-        if (!strequal(lastSpeechData->lastSpeechOutput, buf)) {
-            fprintf(stdout, "%s %s %s\n", buf, textToSpeech(vc830Data->prefix), textToSpeech(vc830Data->unit));
-            strncpy(lastSpeechData->lastSpeechOutput, buf, BUFFER_LEN);
-            ret = 1;    // Data output done
-            //fprintf(stdout, "%s %s %s %s\n", vc830Data->value, buf, textToSpeech(vc830Data->prefix), textToSpeech(vc830Data->unit));
+    double v = vc830Data->siValue;
+    if (!d->rel) {
+        d->hasReference = d->absoluteUnit == unit && !vc830Data->overflow;
+        d->reference    = d->absolute;
+        if (d->hasReference && fabs(v - d->absolute) < fabs(v)) {
+            d->reference = v;  // The first REL paket still shows the new reference, not 0
+            v            = 0;
         }
-        strncpy(lastSpeechData->formatedValue, vc830Data->formatedValue, BUFFER_LEN);
     }
-    //fprintf(stdout, "----------------------\n");
-    //showDataKeyValue(vc830Data, timeText);
-    //fprintf(stdout, "----------------------\n");
+    if (unit != d->absoluteUnit) d->hasReference = false;
+    d->rel = true;
+    if (!d->hasReference || vc830Data->overflow) return;
+
+    sampleHasAbsolute = true;
+    sampleReference   = d->reference;
+    sampleAbsolute    = v + d->reference;
+}
+
+// --------------------------------------------------------------------------------------------------------------
 
+//
+// HOLD, MIN and MAX, "-e". Frames with HOLD repeat the held value, they are not printed as samples.
+// One "hold" record per interval is printed when it ends, with the held value, the number of frames
+// and the duration. A new held value starts a new interval. MIN and MAX frames show the extremum
+// since the key was pressed, they are printed with an extremum field. Both are not new measurements,
+// so they are only counted in the statistics and not used for fusion and trend.
+//
+int holdEnd(int device, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    static struct Record r;
+    struct Device       *d = &devices[device];
+
+    if (!d->hold) return 0;
+    d->hold = false;
+
+    recordBegin(&r, "hold", d->holdStart);
+    recordString(&r, "device", d->name);
+    recordString(&r, "unit", unitNameOf(d->holdUnit));
+    if (d->holdOverflow)
+        recordBool(&r, "overflow", true);
+    else
+        recordDouble(&r, "value", d->holdValue);
+    recordInt(&r, "frames", d->holdFrames);
+    recordDouble(&r, "duration", usecBetween(d->holdStart, d->holdLast) / 1e6);
+    if (listenFd < 0) return showRecord(&r, outputFormat, timeFormat);
+
+    // Rendered once like a sample, for stdout and the clients subscribed to the device, unit and hold
+    rewind(sampleStream);
+    output  = sampleStream;
+    int ret = showRecord(&r, outputFormat, timeFormat);
+    fflush(sampleStream);
+    output = stdout;
+
+    long len = ftell(sampleStream);
+    if (len >= SAMPLE_BUFFER_LEN - 1) exitWithError("Sample buffer too small");
+    if (len > 0) {
+        fwrite(sampleBuffer, 1, len, stdout);
+        routeSample(device, d->holdUnit | STATUS_HOLD, d->holdOverflow, sampleBuffer, len);
+    }
     return ret;
 }
 
+// Returns true if the sample is a held frame and not printed
+bool holdSample(int device, struct Vc830 *vc830Data, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct Device *d    = &devices[device];
+    bool           held = (vc830Data->status & STATUS_HOLD) && !(vc830Data->status & (STATUS_MIN | STATUS_MAX));
+
+    sampleExtremum = vc830Data->status & STATUS_MAX ? "MAX" : vc830Data->status & STATUS_MIN ? "MIN" : NULL;
+    if (!held) {
+        holdEnd(device, outputFormat, timeFormat);
+        return false;
+    }
+
+    if (d->hold && (d->holdOverflow != vc830Data->overflow || d->holdValue != vc830Data->siValue ||
+                    d->holdUnit != (vc830Data->status & STATUS_UNITS)))
+        holdEnd(device, outputFormat, timeFormat);
+    if (!d->hold) {
+        d->hold         = true;
+        d->holdStart    = vc830Data->receivedAt;
+        d->holdFrames   = 0;
+        d->holdValue    = vc830Data->siValue;
+        d->holdOverflow = vc830Data->overflow;
+        d->holdUnit     = vc830Data->status & STATUS_UNITS;
+    }
+    d->holdLast = vc830Data->receivedAt;
+    d->holdFrames++;
+    return true;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 
 //
-// Outputs data for the given format.
-// Return:  1 = Data printed
-//          0 = Data not printed
-//         -1 = Unknown output data format
+// Outputs a decoded sample. With "-l port" the output is rendered once into sampleBuffer and
+// written to stdout and to the subscribed clients. Returns the number of printed outputs.
 //
-int showData(struct Vc830 *vc830Data, const char *outputFormat,
-             const char *timeFormat)
+int outputSample(int device, struct Vc830 *vc830Data, const byte *paket, long window,
+                 const struct OutputFormat *outputFormat, const char *timeFormat)
 {
-    char *timeText = NULL;
+    int ret;
 
-    // iso, local, epochsecms, human, none
-    if (strequal(timeFormat, "iso")) {
-        timeText = getIso8601Time(vc830Data->receivedAt);
+    sampleDevice = deviceCount > 1 || relayDevices > 0 ? devices[device].name : NULL;
+    sampleName   = devices[device].name;
+    samplePaket  = paket;
+    sampleSeq    = devices[device].frames;
+    sampleIndex  = device;
+    if (relAbsolute) relSample(device, vc830Data);
+    if (autorangeReport > 0) autorangeSample(device, vc830Data, paket);  // Held frames also show the range
+    if (holdAware && holdSample(device, vc830Data, outputFormat, timeFormat) && window == 0) return 0;
+    if (listenFd < 0) {
+        if (window > 0)
+            ret = aggregateSample(vc830Data, window, outputFormat, timeFormat);
+        else
+            ret = showData(vc830Data, outputFormat, timeFormat);
     }
-    if (strequal(timeFormat, "local")) {
-        timeText = getLocalDateTime(vc830Data->receivedAt);
+    else {
+        rewind(sampleStream);
+        output = sampleStream;
+        if (window > 0)
+            ret = aggregateSample(vc830Data, window, outputFormat, timeFormat);
+        else
+            ret = showData(vc830Data, outputFormat, timeFormat);
+        fflush(sampleStream);
+        output = stdout;
+
+        long len = ftell(sampleStream);
+        if (len >= SAMPLE_BUFFER_LEN - 1) exitWithError("Sample buffer too small");
+        if (len > 0) {
+            fwrite(sampleBuffer, 1, len, stdout);
+            routeSample(device, vc830Data->status, vc830Data->overflow, sampleBuffer, len);
+        }
     }
-    if (strequal(timeFormat, "human")) {
-        timeText = getLocalTime(vc830Data->receivedAt);
+    samplesOutput += ret;
+
+    // Fusion, trend and calibration records are printed after the sample, they don't count as outputs
+    if (holdAware && (vc830Data->status & (STATUS_HOLD | STATUS_MIN | STATUS_MAX))) return ret;
+    if (devices[device].group >= 0) fusionSample(device, vc830Data, outputFormat, timeFormat);
+    if (trendWindow > 0) trendSample(device, vc830Data, outputFormat, timeFormat);
+    if (calStepCount > 0) calibrationSample(device, vc830Data, paket, outputFormat, timeFormat);
+    return ret;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Relay. The samples of the relay:// streams are collected in a min heap by their receive time at the
+// source. A sample is output RELAY_DELAY_MSEC after it arrived here, so samples of slower streams are
+// sorted in before. The delay is measured with the local clock, clock offsets between the hosts only
+// change the order, not the latency.
+//
+struct RelaySample {
+    int            device;      // DEVICE_RELAYED
+    struct timeval receivedAt;  // At the source
+    struct timeval arrivedAt;   // Here
+    byte           paket[PAKET_LEN];
+};
+
+struct RelaySample relayQueue[RELAY_QUEUE_LEN];
+int                relayQueueLen = 0;
+
+bool relayBefore(const struct RelaySample *a, const struct RelaySample *b) { return usecBetween(b->receivedAt, a->receivedAt) < 0; }
+
+void relayQueuePush(const struct RelaySample *s)
+{
+    int i = relayQueueLen++;
+
+    while (i > 0 && relayBefore(s, &relayQueue[(i - 1) / 2])) {
+        relayQueue[i] = relayQueue[(i - 1) / 2];
+        i             = (i - 1) / 2;
     }
-    if (strequal(timeFormat, "epochsecms")) {
-        timeText = getEpochSecMsTime(vc830Data->receivedAt);
+    relayQueue[i] = *s;
+}
+
+struct RelaySample relayQueuePop()
+{
+    struct RelaySample top  = relayQueue[0];
+    struct RelaySample last = relayQueue[--relayQueueLen];
+    int                i    = 0;
+
+    while (true) {
+        int child = i * 2 + 1;
+        if (child >= relayQueueLen) break;
+        if (child + 1 < relayQueueLen && relayBefore(&relayQueue[child + 1], &relayQueue[child])) child++;
+        if (!relayBefore(&relayQueue[child], &last)) break;
+        relayQueue[i] = relayQueue[child];
+        i             = child;
     }
-    if (strequal(timeFormat, "none")) {
-        timeText = "";
+    relayQueue[i] = last;
+    return top;
+}
+
+int relayOutput(struct RelaySample *s, unsigned fields, long window, const struct OutputFormat *outputFormat,
+                const char *timeFormat)
+{
+    struct Device *d = &devices[s->device];
+    struct Vc830   vc830Data;
+
+    if (decodeFS9922Paket(s->paket, fields, &vc830Data) != 0) {
+        d->decodeErrors++;
+        return 0;
     }
+    vc830Data.receivedAt = s->receivedAt;
+    d->frames++;
 
-    if (timeText == NULL) showUsageAndExit("Unknown time format.");
+    int ret = outputSample(s->device, &vc830Data, s->paket, window, outputFormat, timeFormat);
+    PROBE2(sample_output, s->device, ret);
+    if (ret > 0) fflush(stdout);
+    return ret > 0 ? ret : 0;
+}
+
+// Outputs the samples which waited RELAY_DELAY_MSEC, at most 'remaining'. Returns the number of printed outputs.
+int relayFlush(unsigned fields, long window, const struct OutputFormat *outputFormat, const char *timeFormat,
+               long remaining)
+{
+    struct timeval now;
+    int            outputs = 0;
+
+    gettimeofday(&now, NULL);
+    while (relayQueueLen > 0 && outputs < remaining &&
+           usecBetween(relayQueue[0].arrivedAt, now) >= RELAY_DELAY_MSEC * 1000LL) {
+        struct RelaySample s = relayQueuePop();
+        outputs += relayOutput(&s, fields, window, outputFormat, timeFormat);
+    }
+    return outputs;
+}
+
+// poll() timeout until the next relayed sample is due, or timeout if it is earlier
+int relayTimeout(int timeout)
+{
+    if (relayQueueLen == 0) return timeout;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    long long wait = RELAY_DELAY_MSEC - usecBetween(relayQueue[0].arrivedAt, now) / 1000 + 1;  // ms, rounded up
+    if (wait < 0) wait = 0;
+    if (wait > RELAY_DELAY_MSEC + 1) wait = RELAY_DELAY_MSEC + 1;  // The clock was set back
+    return timeout < 0 || wait < timeout ? wait : timeout;
+}
+
+// Returns the device of a relay:// stream for the name, it is added for the first sample. -1 if devices[] is full.
+int relayedDevice(int relay, const byte *name, int nameLen)
+{
+    static bool full = false;
+    char        fullName[BUFFER_LEN];
+
+    snprintf(fullName, sizeof(fullName), "%s/%.*s", devices[relay].name, nameLen, (const char *)name);
+    for (int d = 0; d < deviceCount; d++) {
+        if (devices[d].type == DEVICE_RELAYED && devices[d].relay == relay && strequal(devices[d].relayName, fullName)) return d;
+    }
+
+    if (deviceCount >= MAX_DEVICES) {
+        if (!full) fprintf(stderr, "vc830: Too many devices, samples of %s are dropped\n", fullName);
+        full = true;
+        return -1;
+    }
+
+    int            device = deviceCount++;
+    struct Device *d      = &devices[device];
+
+    memset(d, 0, sizeof(*d));
+    d->type  = DEVICE_RELAYED;
+    d->relay = relay;
+    snprintf(d->relayName, sizeof(d->relayName), "%s", fullName);
+    d->name = d->relayName;
+    d->path  = devices[relay].path;
+    d->fd    = -1;
+    d->group = -1;
+    subscribeNewDevice(device);
+    groupAttach(device);
+    return device;
+}
+
+// Parses the records of a relay:// stream into relayQueue. Returns the number of printed outputs, if
+// the queue was full.
+int relayReceive(int device, const byte *buf, ssize_t len, struct timeval now, unsigned fields, long window,
+                 const struct OutputFormat *outputFormat, const char *timeFormat, long remaining)
+{
+    struct Device *d       = &devices[device];
+    byte          *r       = d->relayBuf;
+    int            outputs = 0;
+
+    for (ssize_t i = 0; i < len && outputs < remaining; i++) {  // At the count the rest isn't read, no sample is dropped
+        r[d->relayLen++] = buf[i];
+        if (r[0] != RELAY_MAGIC) {
+            scheduleReconnect(device, "No relay stream, use -f relay");
+            return outputs;
+        }
+        if (d->relayLen < RELAY_HEADER_LEN || d->relayLen < RELAY_HEADER_LEN + r[1]) continue;
+        d->relayLen = 0;
+        d->frames++;
+
+        int relayed = relayedDevice(device, r + RELAY_HEADER_LEN, r[1]);
+        if (relayed < 0) continue;
+
+        struct Device *rd  = &devices[relayed];
+        unsigned long  seq = 0;
+        long long      usec = 0;
+        for (int b = 0; b < 4; b++) seq = seq << 8 | r[2 + b];
+        for (int b = 0; b < 8; b++) usec = usec << 8 | r[6 + b];
+
+        // Sequence numbers start with 1, smaller ones are a restart of the source
+        if (rd->relaySeq > 0 && seq > rd->relaySeq + 1) rd->lost += seq - rd->relaySeq - 1;
+        rd->relaySeq = seq;
+
+        struct RelaySample s;
+        s.device            = relayed;
+        s.receivedAt.tv_sec  = usec / 1000000;
+        s.receivedAt.tv_usec = usec % 1000000;
+        s.arrivedAt         = now;
+        memcpy(s.paket, r + 14, PAKET_LEN);
+
+        if (relayQueueLen == RELAY_QUEUE_LEN) {  // Full, the oldest sample can't wait longer
+            struct RelaySample oldest = relayQueuePop();
+            outputs += relayOutput(&oldest, fields, window, outputFormat, timeFormat);
+        }
+        relayQueuePush(&s);
+    }
+    return outputs;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Does all allocations of the libc up front: stdio buffer and time zone data.
+// After this, the memory usage is flat.
+//
+char stdoutBuffer[STDOUT_BUFFER_LEN];
+
+void initStaticMemory()
+{
+    setvbuf(stdout, stdoutBuffer, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, sizeof(stdoutBuffer));
+    output = stdout;
+    tzset();
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+void reportMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#if defined(__APPLE__)
+    long maxRssKb = usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    long maxRssKb = usage.ru_maxrss;
+#endif
+    fprintf(stderr, "vc830: max. RSS after init %ld kB\n", maxRssKb);
+}
+
+// --------------------------------------------------------------------------------------------------------------
 
-    // keyvalue, json, human, si
-    if (strequal(outputFormat, "keyvalue")) {
-        showDataKeyValue(vc830Data, timeText);
-        return 1;
+//
+// Line quality of a device, printed every "-q seconds" and at the end. The counters are totals since
+// the start. The UART counters (TIOCGICOUNT) are only available for some serial drivers.
+//
+int showLineReport(int device, const struct OutputFormat *outputFormat, const char *timeFormat)
+{
+    struct Device       *d = &devices[device];
+    static struct Record r;
+    struct timeval       now;
+
+    gettimeofday(&now, NULL);
+    recordBegin(&r, "line", now);
+
+    recordString(&r, "device", d->name);
+    recordInt(&r, "frames", d->frames);
+    recordInt(&r, "decodeErrors", d->decodeErrors);
+    recordInt(&r, "resyncs", d->framer.resyncs);
+    recordInt(&r, "lineErrors", d->framer.lineErrors);
+    if (d->type == DEVICE_RELAYED) recordInt(&r, "lost", d->lost);
+    if (d->type != DEVICE_LOCAL && d->type != DEVICE_RELAYED) recordInt(&r, "reconnects", d->reconnects);
+
+#if defined(TIOCGICOUNT)
+    struct serial_icounter_struct icount;
+    if (d->fd >= 0 && ioctl(d->fd, TIOCGICOUNT, &icount) == 0) {
+        recordInt(&r, "rx", icount.rx);
+        recordInt(&r, "frameErrors", icount.frame);
+        recordInt(&r, "parityErrors", icount.parity);
+        recordInt(&r, "overruns", icount.overrun);
+        recordInt(&r, "bufferOverruns", icount.buf_overrun);
+        recordInt(&r, "breaks", icount.brk);
     }
-    if (strequal(outputFormat, "json")) {
-        showDataJson(vc830Data, timeText);
-        return 1;
+#endif
+
+    return showRecord(&r, outputFormat, timeFormat);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+// Reads the available bytes of a device and outputs the complete pakets, at most 'remaining'.
+// Returns the number of printed outputs.
+int readDevice(int device, unsigned fields, long window, const struct OutputFormat *outputFormat,
+               const char *timeFormat, long remaining)
+{
+    struct Device *d = &devices[device];
+    byte           buf[PAKET_LEN * 64];
+    struct Vc830   vc830Data;
+    int            outputs = 0;
+
+    ssize_t l = read(d->fd, buf, sizeof(buf));
+    if (l < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    if (l <= 0 && d->type != DEVICE_LOCAL) {
+        d->reconnects++;
+        scheduleReconnect(device, l == 0 ? "Connection closed" : strerror(errno));
+        return 0;
     }
-    if (strequal(outputFormat, "human")) {
-        showDataHuman(vc830Data, timeText);
-        return 1;
+    if (l < 0) exitWithError("Read failed");
+    if (l == 0) {  // End of a capture file
+        close(d->fd);
+        d->fd = -1;
+        return 0;
     }
-    if (strequal(outputFormat, "si")) {
-        showDataSi(vc830Data, timeText);
-        return 1;
+    if (d->type == DEVICE_RFC2217) {
+        l = telnetFilter(device, buf, l);
+        if (l == 0) return 0;
     }
-    if (strequal(outputFormat, "speech")) {
-        return showDataSpeech(vc830Data, timeText);
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    if (d->type == DEVICE_RELAY) return relayReceive(device, buf, l, now, fields, window, outputFormat, timeFormat, remaining);
+
+    if (recorderDir) recorderPush(&d->recorder, buf, l, d->lineErrorMarks, now);
+
+    for (ssize_t i = 0; i < l && outputs < remaining; i++) {
+        long resyncs  = d->framer.resyncs;
+        bool complete = d->lineErrorMarks ? framerPushMarked(&d->framer, buf[i], now) : framerPush(&d->framer, buf[i], now);
+        if (d->framer.resyncs != resyncs) {
+            PROBE1(resync, device);
+            recorderTrigger(device, "resync", now);
+        }
+        if (!complete) continue;
+
+        PROBE2(frame_received, device, d->framer.buf);
+        int error = decodeFS9922Paket(d->framer.buf, fields, &vc830Data);
+        if (error != 0) {
+            PROBE2(decode_error, device, error);  // -1, -2, -3, see decodeFS9922Paket()
+            d->decodeErrors++;
+            if (recorderDir) recorderDecodeError(device, now);
+            continue;
+        }
+        d->frames++;
+
+        int ret = outputSample(device, &vc830Data, d->framer.buf, window, outputFormat, timeFormat);
+        PROBE2(sample_output, device, ret);
+        if (ret > 0) {
+            fflush(stdout);
+            outputs += ret;
+        }
     }
-    return -1;
+    return outputs;
 }
 
 // --------------------------------------------------------------------------------------------------------------
 
+struct pollfd pollFds[MAX_DEVICES + 2 + MAX_CLIENTS];
+int           pollIndex[MAX_DEVICES + 2 + MAX_CLIENTS];  // Device or client index, -1 = listen socket, -2 = stdin
+
 int main(int argc, char **argv)
 {
     int ret;
 
+    initStaticMemory();
+    initKernels();
+
     //
     // Parse arguments
     //
     char outputFormat[BUFFER_LEN];
     char timeFormat[BUFFER_LEN];
     long count = LONG_MAX;  // Almost endless :-)
-    char deviceName[PATH_MAX];
+    long window = 0;        // Statistics window, 0 = output every sample
+    int  port   = 0;        // Listen port for clients, 0 = off
+    long lineReport = 0;    // Line quality report interval in seconds, 0 = off
 
     strcpy(outputFormat, "human");
     strcpy(timeFormat, "none");
-    strcpy(deviceName, "");
 
     for (int i = 1; i < argc; i++) {
-        if (i < argc - 2) {
+        if (i < argc - 2 && deviceCount == 0) {
             if (strequal(argv[i], "-f")) {
                 strcpy(outputFormat, argv[i + 1]);
                 i++;
@@ -808,48 +3921,246 @@ int main(int argc, char **argv)
                 i++;
                 continue;
             }
+            if (strequal(argv[i], "-a")) {
+                char *end;
+                window        = strtol(argv[i + 1], &end, 10);
+                statsHasLevel = *end == ',';
+                if (statsHasLevel) statsLevel = strtod(end + 1, &end);
+                if (window <= 0 || *end) showUsageAndExit("Wrong statistics window.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-l")) {
+                port = atoi(argv[i + 1]);
+                if (port <= 0 || port > 65535) showUsageAndExit("Wrong port.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-d")) {
+                recorderDir = argv[i + 1];
+                if (access(recorderDir, W_OK) != 0) showUsageAndExit("Dump directory not writable.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-q")) {
+                lineReport = atol(argv[i + 1]);
+                if (lineReport <= 0) showUsageAndExit("Wrong line report interval.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-m")) {
+                openMarkerFile(argv[i + 1]);
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-r")) {
+                char *end;
+                trendWindow       = strtod(argv[i + 1], &end);
+                trendHasThreshold = *end == ',';
+                if (trendHasThreshold) trendThreshold = strtod(end + 1, &end);
+                if (trendWindow <= 0 || *end) showUsageAndExit("Wrong trend window.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-u")) {
+                autorangeReport = atol(argv[i + 1]);
+                if (autorangeReport <= 0) showUsageAndExit("Wrong autorange report interval.");
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-s")) {
+                loadSchedule(argv[i + 1]);
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-g")) {
+                addGroup(argv[i + 1]);
+                i++;
+                continue;
+            }
+            if (strequal(argv[i], "-k")) {
+                if (!strequal(argv[i + 1], "string") && !strequal(argv[i + 1], "int")) showUsageAndExit("Unknown key format.");
+                binaryIntKeys = strequal(argv[i + 1], "int");
+                i++;
+                continue;
+            }
+        }
+        if (i < argc - 1 && deviceCount == 0) {  // Flags without a value
+            if (strequal(argv[i], "-e")) {
+                holdAware = true;
+                continue;
+            }
+            if (strequal(argv[i], "-b")) {
+                relAbsolute = true;
+                continue;
+            }
+        }
+        if (deviceCount == 0 && strequal(argv[i], "-h")) showUsageAndExit(NULL);
+
+        addDevice(argv[i]);  // All following parameters are devices
+    }
+    if (deviceCount == 0) showUsageAndExit("Missing instrument device.");
+    if (window > 0 && (deviceCount > 1 || relayDevices > 0)) showUsageAndExit("Statistics need a single device.");
+
+    for (int d = 0; d < deviceCount; d++) groupAttach(d);
+    for (int g = 0; g < groupCount && relayDevices == 0; g++) {
+        for (int m = 0; m < groups[g].memberCount; m++) {
+            if (groups[g].members[m].device < 0) showUsageAndExit("No device for a group member.");
         }
+    }
+
+    const struct OutputFormat *format = findOutputFormat(outputFormat);
+    if (format == NULL) showUsageAndExit("Unknown output format");
+
+    initBinaryKeys(&cborCodec);
+    initBinaryKeys(&msgpackCodec);
 
-        strncpy(deviceName, argv[i], sizeof(deviceName) - 1);
-        deviceName[sizeof(deviceName) - 1] = '\0';
-        break;  // must be the last parameter
+    // Only the fields which are read by the active output are decoded
+    unsigned fields = format->fields;
+    if (groupCount > 0 || trendWindow > 0 || relAbsolute) fields |= FIELD_UNIT;
+    if (window > 0) {
+        fields = FIELD_UNIT;  // Only statistics records are printed
+        aggregateReset(&statsAggregate);
     }
-    if (!deviceName[0]) showUsageAndExit("Missing instrument device.");
 
     //
-    // Open device or captured file
+    // Open devices or captured files
     //
-    int fd = openDevice(deviceName);
-    if (fd < 0) exitWithError("Open device failed");
+    int networkDevices = 0;
+    for (int d = 0; d < deviceCount; d++) {
+        if (devices[d].type != DEVICE_LOCAL) {
+            connectDevice(d);  // Failed connects are retried in the loop
+            networkDevices++;
+            continue;
+        }
+        devices[d].fd = openDevice(devices[d].path);
+        if (devices[d].fd < 0) exitWithError("Open device failed");
+        if (lineReport > 0 && isatty(devices[d].fd)) {
+            if (enableLineErrorMarks(devices[d].fd) != 0) exitWithError("Line error detection failed");
+            devices[d].lineErrorMarks = true;
+        }
+    }
+
+    if (recorderDir) signal(SIGUSR1, recorderSignal);
+
+    if (port > 0) {
+        sampleStream = fmemopen(sampleBuffer, sizeof(sampleBuffer), "w");
+        if (sampleStream == NULL) exitWithError("fmemopen failed");
+        listenOn(port);
+    }
+
+#if defined(VC830_EMBEDDED)
+    reportMemory();
+#endif
 
     //
     // Loop over device reads
     //
-    byte         readBuffer[BUFFER_LEN];
-    struct Vc830 vc830Data;
-    long         outputCounter = 0;
+    long           outputCounter = 0;
+    struct timeval nextLineReport, nextAutorangeReport;
+
+    gettimeofday(&nextLineReport, NULL);
+    nextAutorangeReport = nextLineReport;
+    nextLineReport.tv_sec += lineReport;
+    nextAutorangeReport.tv_sec += autorangeReport;
 
     while (outputCounter < count) {
+        int timeout = lineReport > 0 || autorangeReport > 0 ? 1000 : -1;
+        if (networkDevices > 0) timeout = connectDueDevices(timeout);
+        if (relayDevices > 0) timeout = relayTimeout(timeout);
+        if (groupCount > 0) timeout = fusionTimeout(timeout);
+
+        int n = 0;
+        for (int d = 0; d < deviceCount; d++) {
+            if (devices[d].fd < 0) continue;
+            pollFds[n]     = (struct pollfd){ devices[d].fd, devices[d].connecting ? POLLOUT : POLLIN, 0 };
+            pollIndex[n++] = d;
+        }
+        int devicePolls = n;
+        if (devicePolls == 0 && networkDevices == 0) break;  // --> terminate, all capture files are read
+
+        if (markerStdin) {
+            pollFds[n]     = (struct pollfd){ STDIN_FILENO, POLLIN, 0 };
+            pollIndex[n++] = -2;
+        }
+        if (listenFd >= 0) {
+            pollFds[n]     = (struct pollfd){ listenFd, POLLIN, 0 };
+            pollIndex[n++] = -1;
+            for (int c = 0; c < MAX_CLIENTS; c++) {
+                if (clients[c].fd < 0) continue;
+                pollFds[n]     = (struct pollfd){ clients[c].fd, POLLIN, 0 };
+                pollIndex[n++] = c;
+            }
+        }
 
-        ret = read14BytesPaket(fd, readBuffer);
-        if (ret == END_OF_CAPTURE_FILE) break;  // --> terminate
-        if (ret != 0) exitWithError("Read failed");
+        ret = poll(pollFds, n, timeout);
+        if (ret < 0 && errno != EINTR) exitWithError("Poll failed");
 
-        ret = decodeFS9922Paket(readBuffer, &vc830Data);
-        if (ret != 0) {
-            continue;
+        if (lineReport > 0) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            if (usecBetween(nextLineReport, now) >= 0) {
+                for (int d = 0; d < deviceCount; d++) showLineReport(d, format, timeFormat);
+                fflush(stdout);
+                nextLineReport.tv_sec += lineReport;
+            }
+        }
+        if (autorangeReport > 0) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            if (usecBetween(nextAutorangeReport, now) >= 0) {
+                for (int d = 0; d < deviceCount; d++) showAutorangeReport(d, format, timeFormat);
+                fflush(stdout);
+                nextAutorangeReport.tv_sec += autorangeReport;
+            }
         }
 
-        ret = showData(&vc830Data, outputFormat, timeFormat);
-        if (ret == 1) {
-            fflush(stdout);
-            outputCounter++;
+        if (recorderDumpRequested) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            recorderDumpRequested = 0;
+            for (int d = 0; d < deviceCount; d++) recorderDump(d, "signal", now);
         }
 
-        if (ret == -1) showUsageAndExit("Unknown output format");
+        for (int p = 0; p < n && ret > 0 && outputCounter < count; p++) {
+            if (!(pollFds[p].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR))) continue;
+
+            if (p < devicePolls && devices[pollIndex[p]].connecting)
+                connectDone(pollIndex[p]);
+            else if (p < devicePolls)
+                outputCounter += readDevice(pollIndex[p], fields, window, format, timeFormat, count - outputCounter);
+            else if (pollIndex[p] == -2)
+                readMarkers(format, timeFormat);
+            else if (pollIndex[p] < 0)
+                acceptClient();
+            else if (clients[pollIndex[p]].fd >= 0)
+                readClient(pollIndex[p], format, timeFormat);
+        }
+        if (relayDevices > 0 && outputCounter < count) outputCounter += relayFlush(fields, window, format, timeFormat, count - outputCounter);
+        if (groupCount > 0) fusionFlush(format, timeFormat);
+        if (calStepCount > 0 && calibrationDone()) break;
 
     }  // while
 
-    close(fd);
+    if (window > 0 && outputCounter < count) showStats(format, timeFormat);  // Incomplete last window
+    for (int g = 0; g < groupCount; g++) {
+        if (groups[g].roundOpen) fusionRound(&groups[g], format, timeFormat);
+    }
+    for (int d = 0; d < deviceCount && holdAware; d++) holdEnd(d, format, timeFormat);
+    if (lineReport > 0) {
+        for (int d = 0; d < deviceCount; d++) showLineReport(d, format, timeFormat);
+    }
+    for (int d = 0; d < deviceCount && autorangeReport > 0; d++) showAutorangeReport(d, format, timeFormat);
+    if (calStepCount > 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        for (int d = 0; d < deviceCount; d++) {
+            if (devices[d].type != DEVICE_RELAY) calibrationReport(d, now, format, timeFormat);
+        }
+    }
+
+    for (int d = 0; d < deviceCount; d++) {
+        if (devices[d].fd >= 0) close(devices[d].fd);
+    }
     exit(0);
 }
@@ -0,0 +1,547 @@
+/*
+ * =============================================================================
+ *             (c) by Thomas Welsch / 2021 under the MIT License
+ * =============================================================================
+ *
+ * FS9922-DMM4 protocol decoder and device access for the Voltcraft VC-830.
+ * Based on datasheet FS9922-DMM4-DS-15_EN.pdf.
+ *
+ * Used by the vc830 program and the language bindings (python/, vc830.hpp),
+ * all functions are static inline. Compiles as C and C++.
+ */
+
+#ifndef VC830_H
+#define VC830_H
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------------------------------------------
+
+#ifndef BUFFER_LEN
+#define BUFFER_LEN 100  // Used for all kind of static allocations...
+#endif
+
+#define END_OF_CAPTURE_FILE 142857  // EOF of test file reached
+
+typedef unsigned char byte;
+
+#define strequal(s1, s2) (strcmp((s1), (s2)) == 0)
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Static tracepoints (USDT, provider "vc830") for perf and bpftrace. They are built in if <sys/sdt.h>
+// is available (systemtap-sdt-dev) and are a single nop each until a tracer attaches. Without the header
+// or with -DVC830_NO_PROBES they compile to nothing.
+//
+#if !defined(VC830_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define VC830_PROBES
+#endif
+#endif
+
+#if defined(VC830_PROBES)
+#define PROBE1(name, a1)             DTRACE_PROBE1(vc830, name, a1)
+#define PROBE2(name, a1, a2)         DTRACE_PROBE2(vc830, name, a1, a2)
+#define PROBE3(name, a1, a2, a3)     DTRACE_PROBE3(vc830, name, a1, a2, a3)
+#else
+#define PROBE1(name, a1)             do {} while (0)
+#define PROBE2(name, a1, a2)         do {} while (0)
+#define PROBE3(name, a1, a2, a3)     do {} while (0)
+#endif
+
+struct Vc830 {
+    struct timeval receivedAt;                   // Time with mills
+    char           rawRisplay[6];                // 0.000
+    char           sign;                         // -/+
+    char           mode[BUFFER_LEN];             // AC/DC/AC HOLD/AC REL...
+    char           unit[BUFFER_LEN];             // A/V...
+    char           prefix[BUFFER_LEN];           // m, µ, K....
+    char           fullUnit[BUFFER_LEN];         // combined units,  mA,V, mV...
+    char           info[BUFFER_LEN];             // Other infos, not fits currently to the other fields
+    int            barGraph;                     // Bar graph level in %, 0..60, above 60 the autorange is switing to the next upper range
+    bool           barGraphIsShown;              // The bar graph is displayed
+    bool           batteryWarning;               // Battery warning is diesplayed
+    bool           autoRangeActive;              // Auto range is active
+    bool           holdActive;                   // Measurement on holdwith hold key
+    bool           deltaActive;                  // Measurement switch to REL/DELTA mode. no absolute value!
+    bool           overflow;                     // Overflow, mostly if autorange is switched off
+    char           value[BUFFER_LEN];            // Formated value
+    char           formatedValue[BUFFER_LEN];    // Formated value with measurement unit
+    char           formatedSiValue[BUFFER_LEN];  // Formated value, normed to SI base unit
+    char           lastSpeechOutput[BUFFER_LEN]; // Last output from speech. Used to avoid repetitions.    
+    double         siValue;                      // Value normed to SI base unit, always decoded
+    double         resolution;                   // One digit of the range in the SI base unit, always decoded
+    unsigned       status;                       // Raw status bytes SB1..SB4, see STATUS_xxx
+};
+
+// Bits in struct Vc830.status. SB1 is the most significant byte.
+#define STATUS_BIT(statusByte, statusBit) (1u << ((4 - (statusByte)) * 8 + (statusBit)))
+
+#define STATUS_AUTO  STATUS_BIT(1, 5)
+#define STATUS_DC    STATUS_BIT(1, 4)
+#define STATUS_AC    STATUS_BIT(1, 3)
+#define STATUS_REL   STATUS_BIT(1, 2)
+#define STATUS_HOLD  STATUS_BIT(1, 1)
+#define STATUS_MAX   STATUS_BIT(2, 5)
+#define STATUS_MIN   STATUS_BIT(2, 4)
+#define STATUS_BAT   STATUS_BIT(2, 2)
+#define STATUS_BEEP  STATUS_BIT(3, 3)
+#define STATUS_DIODE STATUS_BIT(3, 2)
+#define STATUS_UNITS 0xffu  // SB4, one bit per unit
+
+// Fields of struct Vc830 which are only filled on request (see decodeFS9922Paket()).
+// The numeric fields (sign, barGraph, siValue and the bool flags) are always decoded.
+#define FIELD_RAW_DISPLAY     0x01  // rawRisplay
+#define FIELD_MODE            0x02  // mode
+#define FIELD_INFO            0x04  // info
+#define FIELD_UNIT            0x08  // unit, prefix, fullUnit
+#define FIELD_VALUE           0x10  // value
+#define FIELD_FORMATED_VALUE  0x20  // formatedValue
+#define FIELD_FORMATED_SI     0x40  // formatedSiValue
+#define FIELD_ALL             0x7f
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline void setRtsDtr(int fd)
+{
+    int arg = TIOCM_RTS | TIOCM_DTR;
+    ioctl(fd, TIOCMBIS, &arg);
+    arg = TIOCM_RTS;
+    ioctl(fd, TIOCMBIC, &arg);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline int openDevice(const char *deviceName)
+{
+    speed_t bdflag =
+        B2400;  // All VC-830 with FS9922-DMM4 chips are using 2400 Baud, 8N1
+
+    static struct termios tty;
+    int                   modelines = 0;
+
+    int fd = open(deviceName, O_RDWR | O_NOCTTY | O_NDELAY);
+
+    if (fd < 0) {
+        int err = errno;
+        perror("open failed");
+        errno = err;  // For the callers, perror() may change it
+        return (-1);
+    }
+
+    if (isatty(fd)) {
+        tcgetattr(fd, &tty);
+        tty.c_iflag     = IGNBRK | IGNPAR;
+        tty.c_lflag     = 0;
+        tty.c_oflag     = 0;                             // raw output
+        tty.c_cc[VTIME] = 0;                             // no waiting
+        tty.c_cc[VMIN]  = 1;                             // minimum of reading bytes, was 1
+        tty.c_cflag     = CS8 | CREAD | CLOCAL | HUPCL;  // was STD_FLG; 8N1, read, no modem status,
+#ifdef __linux__
+        tty.c_line = 0;
+#endif
+
+        cfsetispeed(&tty, bdflag);  // input
+        cfsetospeed(&tty, bdflag);  // output
+
+        if (tcsetattr(fd, TCSAFLUSH, &tty) == -1) {
+            perror("tcsetattr TCSAFLUSH failed");
+            return (-1);
+        }
+
+        if (ioctl(fd, TIOCEXCL, &modelines) == -1) {  // Put the tty into exclusive mode.
+            perror("ioctl TIOCEXCL failed");
+            return (-1);
+        }
+
+        setRtsDtr(fd);           // DTR/RTS, important for voltage supply to RS232 optical converter
+        tcflush(fd, TCIOFLUSH);  // flush buffers
+    }
+    else {
+        // fprintf(stderr, "The Device %s is not a terminal device, reading captured
+        // data !\n", deviceName);
+    }
+
+    return (fd);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Opt-in line error detection for ttys opened by openDevice(). Instead of dropping bytes with parity or
+// framing errors (IGNPAR), they are marked in the input (PARMRK), see framerPushMarked().
+// Return: 0 = OK, -1 = error
+//
+static inline int enableLineErrorMarks(int fd)
+{
+    struct termios tty;
+
+    if (tcgetattr(fd, &tty) != 0) return -1;
+    tty.c_iflag &= ~(IGNPAR | IGNBRK | BRKINT | ISTRIP);
+    tty.c_iflag |= INPCK | PARMRK;
+    return tcsetattr(fd, TCSANOW, &tty);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline void strinsert(char *srcAndDest, int pos, const char *toInsert)
+{
+    char buf[BUFFER_LEN];
+
+    snprintf(buf, sizeof(buf), "%.*s%s%s", pos, srcAndDest, toInsert, srcAndDest + pos);
+    strcpy(srcAndDest, buf);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline bool checkInfo(byte buf[], int statusByte, int statusBit, const char *info, char *out)
+{
+    if (buf[7 + statusByte - 1] & (1 << statusBit)) {
+        if (out) {
+            if (out[0]) strcat(out, " ");
+            strcat(out, info);
+        }
+        return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline void trimZeros(char *s)
+{
+    char *e = strchr(s, '\0');
+    while (e > s) {
+        e--;
+        if (*e != '0') return;
+        if (e > s && *(e - 1) == '.') return;  // keep last zero after point
+        *e = '\0';
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Decodes a 14 byte paket into vc830Data.
+// Only the string fields selected in 'fields' (FIELD_xxx) are formated, all
+// other string fields are left empty.
+// Return:  0 = OK
+//         -1 = Wrong paket format (space/CRLF)
+//         -2 = Wrong sign
+//         -3 = Wrong digits
+//
+static inline int decodeFS9922Paket(byte buf[], unsigned fields, struct Vc830 *vc830Data)
+{
+    // showBuffer(buf);
+
+    vc830Data->rawRisplay[0]      = '\0';
+    vc830Data->mode[0]            = '\0';
+    vc830Data->unit[0]            = '\0';
+    vc830Data->prefix[0]          = '\0';
+    vc830Data->fullUnit[0]        = '\0';
+    vc830Data->info[0]            = '\0';
+    vc830Data->value[0]           = '\0';
+    vc830Data->formatedValue[0]   = '\0';
+    vc830Data->formatedSiValue[0] = '\0';
+    vc830Data->overflow           = false;
+    vc830Data->status             = 0;
+
+    gettimeofday(&vc830Data->receivedAt, NULL);
+
+    // Check space and CRLF
+    if (buf[5] != 0x20 || buf[12] != 0x0d || buf[13] != 0x0a)
+        return -1;
+
+    // Check sign
+    int sign = 0;
+    if (buf[0] == 0x2b) sign = 1;
+    if (buf[0] == 0x2d) sign = -1;
+
+    if (sign == 0) return -2;
+
+    // Check value/digits
+    char value[6];
+    int  k      = -1;
+    int  digits = 0;
+
+    if (buf[1] == 0x3f && buf[2] == 0x30 && buf[3] == 0x3a && buf[4] == 0x3f) {
+        vc830Data->overflow = true;
+        strcpy(value, "OVF");
+    }
+    else {
+        // Read value
+        for (int i = 0; i < 4; i++) {
+            if (!isdigit(buf[1 + i])) return -3;
+            value[i] = buf[1 + i];
+            digits   = digits * 10 + (buf[1 + i] - '0');
+        }
+        value[4] = '\0';
+
+        // if (buf[6] == 0x30) k = 0;
+        if (buf[6] == 0x31) k = 1;
+        if (buf[6] == 0x32) k = 2;
+        if (buf[6] == 0x33) k = 3;
+        if (buf[6] == 0x34) k = 3;
+
+        // if (buf[6] == 0x34) nk = 1;
+        if (k != -1 && (fields & (FIELD_RAW_DISPLAY | FIELD_VALUE | FIELD_FORMATED_VALUE))) strinsert(value, k, ".");
+    }
+
+    // Check status bytes
+    char  mode[BUFFER_LEN];
+    char  prefix[BUFFER_LEN];
+    char  unit[BUFFER_LEN];
+    char  info[BUFFER_LEN];
+    char *modeOut = (fields & FIELD_MODE) ? mode : NULL;
+    char *infoOut = (fields & FIELD_INFO) ? info : NULL;
+
+    mode[0]   = '\0';
+    prefix[0] = '\0';
+    unit[0]   = '\0';
+    info[0]   = '\0';
+
+    // Status byte SB1:
+    vc830Data->autoRangeActive = checkInfo(buf, 1, 5, "AUTO", infoOut);
+    checkInfo(buf, 1, 4, "DC", modeOut);
+    checkInfo(buf, 1, 3, "AC", modeOut);
+    vc830Data->deltaActive     = checkInfo(buf, 1, 2, "REL", modeOut);  // Delta
+    vc830Data->holdActive      = checkInfo(buf, 1, 1, "HOLD", modeOut);
+    vc830Data->barGraphIsShown = checkInfo(buf, 1, 0, "BPN", NULL);  // Bargraph is shown, info not relevant
+
+    // Status byte SB2:
+    checkInfo(buf, 2, 7, "Diode" /*"Z1"*/, infoOut);  // Diode Unit Volt oder sperre
+    checkInfo(buf, 2, 6, "Z2", infoOut);
+    checkInfo(buf, 2, 5, "MAX", infoOut);
+    checkInfo(buf, 2, 4, "MIN", infoOut);
+    checkInfo(buf, 2, 3, "APO", infoOut);
+    vc830Data->batteryWarning = checkInfo(buf, 2, 2, "Bat", infoOut);
+    checkInfo(buf, 2, 1, "n", prefix);
+    checkInfo(buf, 2, 0, "Z3", infoOut);
+
+    // Status byte SB3:
+    checkInfo(buf, 3, 7, "µ", prefix);
+    checkInfo(buf, 3, 6, "m", prefix);
+    checkInfo(buf, 3, 5, "k", prefix);
+    checkInfo(buf, 3, 4, "M", prefix);
+    checkInfo(buf, 3, 3, "Beep", infoOut);  // Durchgangsprüfung BEEPER
+    checkInfo(buf, 3, 2, "Diode", infoOut);
+    checkInfo(buf, 3, 1, "%", prefix);  // Duty for HZ
+    checkInfo(buf, 3, 0, "Z4", infoOut);
+
+    // Status byte SB4:
+    checkInfo(buf, 4, 7, "V", unit);
+    checkInfo(buf, 4, 6, "A", unit);
+    checkInfo(buf, 4, 5, "Ω", unit);
+    checkInfo(buf, 4, 4, "hFE", unit);
+    checkInfo(buf, 4, 3, "Hz", unit);
+    checkInfo(buf, 4, 2, "F", unit);
+    checkInfo(buf, 4, 1, "°C", unit);
+    checkInfo(buf, 4, 0, "°F", unit);
+
+    double multToSi = 1;
+    if (strequal(prefix, "n")) multToSi = 0.000000001;
+    if (strequal(prefix, "µ")) multToSi = 0.000001;
+    if (strequal(prefix, "m")) multToSi = 0.001;
+    if (strequal(prefix, "k")) multToSi = 1000;
+    if (strequal(prefix, "M")) multToSi = 1000000;
+
+    // Bar % (0-60)
+    byte bar = buf[11] & 0x7f;  // Hi-Bit is sign
+
+    // Same result as atof(value), without parsing the digits again
+    double vAbs = 0;
+    if (!vc830Data->overflow) {
+        vAbs = digits;
+        if (k == 1) vAbs = digits / 1000.0;
+        if (k == 2) vAbs = digits / 100.0;
+        if (k == 3) vAbs = digits / 10.0;
+    }
+
+    // For the none normalized values (comming from the digits) we keep the
+    // resolution. For the SI base unit normalized values, we scrap the trailing
+    // '0', even if the are comming from the display...
+    double vSi = vAbs * multToSi * sign;
+
+    // Copy to output structure
+    vc830Data->sign       = sign == 1 ? '+' : '-';
+    vc830Data->barGraph   = bar;
+    vc830Data->siValue    = vSi;
+    vc830Data->resolution = (k == 1 ? 0.001 : k == 2 ? 0.01 : k == 3 ? 0.1 : 1) * multToSi;
+    vc830Data->status     = buf[7] << 24 | buf[8] << 16 | buf[9] << 8 | buf[10];
+
+    if (modeOut) strcpy(vc830Data->mode, mode);
+    if (infoOut) strcpy(vc830Data->info, info);
+    if (fields & FIELD_UNIT) {
+        strcpy(vc830Data->unit, unit);
+        strcpy(vc830Data->prefix, prefix);
+        strcpy(vc830Data->fullUnit, prefix);
+        strcat(vc830Data->fullUnit, unit);
+    }
+
+    if (fields & (FIELD_RAW_DISPLAY | FIELD_VALUE | FIELD_FORMATED_VALUE)) {
+        // Strip '0' at the start:
+        char *vz = value;
+        while (*vz == '0' && *(vz + 1) != '.') vz++;
+
+        // Strip "." at the end:
+        char *se = strrchr(vz, '.');
+        if (se && strequal(se, ".0")) *se = '\0';
+
+        if (fields & FIELD_RAW_DISPLAY) strcpy(vc830Data->rawRisplay, value);
+        if (fields & FIELD_VALUE) strcpy(vc830Data->value, vz);
+
+        if (fields & FIELD_FORMATED_VALUE) {
+            char *vWithUnit = vc830Data->formatedValue;
+
+            if (sign == -1) strcat(vWithUnit, "-");
+            strcat(vWithUnit, vz);
+            strcat(vWithUnit, " ");
+            strcat(vWithUnit, prefix);
+            strcat(vWithUnit, unit);
+        }
+    }
+
+    if (fields & FIELD_FORMATED_SI) {
+        char *vSiWithUnit = vc830Data->formatedSiValue;
+
+        snprintf(vSiWithUnit, BUFFER_LEN, "%f", vSi);
+        trimZeros(vSiWithUnit);
+        strcat(vSiWithUnit, " ");
+        strcat(vSiWithUnit, unit);
+    }
+
+    return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+static inline int read14BytesPaket(int fd, byte readBuffer[])
+{
+    fd_set         set;
+    struct timeval timeout;
+    int            bufIdx = 0;
+
+    while (1) {
+        timeout.tv_sec  = 0;
+        timeout.tv_usec = 100000;
+
+        FD_ZERO(&set);    /* clear the set */
+        FD_SET(fd, &set); /* add our file descriptor to the set */
+
+        int ret = select(fd + 1, &set, NULL, NULL, &timeout);
+        if (ret == -1) {
+            perror("select failed");
+            return -1;
+        }
+
+        if (ret == 0) {  // timeout, reset buffer
+            bufIdx = 0;
+            continue;
+        }
+
+        int l = read(fd, &readBuffer[bufIdx], 14 - bufIdx);  // Never more than the rest of the paket
+        if (l == 0) {
+            // This happens only if we are reading a file. For normal TTY devices
+            // the above select() returns only if we have data for the read() call.
+            return END_OF_CAPTURE_FILE;
+        }
+        if (l > 0) bufIdx += l;
+
+        if (bufIdx == 14) return 0;
+
+    }  // while (1)
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Incremental version of read14BytesPaket() for event loops: the received bytes are pushed
+// one by one. Like the select() timeout above, a gap of PAKET_GAP_USEC between two bytes
+// starts a new paket.
+//
+#define PAKET_LEN      14
+#define PAKET_GAP_USEC 100000
+
+struct PaketFramer {
+    byte           buf[PAKET_LEN];  // Complete paket after framerPush() returned true
+    int            idx;
+    struct timeval lastByteAt;
+    long           resyncs;       // Incomplete pakets dropped because of a gap
+    int            markState;     // framerPushMarked(): 1 = after \377, 2 = after \377 \0
+    bool           dropUntilGap;  // The current paket had a line error
+    long           lineErrors;    // Bytes received with a parity or framing error, or breaks
+};
+
+static inline void framerReset(struct PaketFramer *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+// Returns true if buf holds a complete paket. It is valid until the next push.
+static inline bool framerPush(struct PaketFramer *f, byte b, struct timeval now)
+{
+    // 64 bit, a 32 bit long overflows after 35 minutes. A clock set back is a gap, too.
+    long long gap  = (now.tv_sec - f->lastByteAt.tv_sec) * 1000000LL + (now.tv_usec - f->lastByteAt.tv_usec);
+    bool      sync = gap >= PAKET_GAP_USEC || gap < 0;
+
+    if (f->idx > 0 && sync) {  // Resync
+        f->resyncs++;
+        f->idx = 0;
+    }
+    f->lastByteAt = now;
+
+    if (f->dropUntilGap) {
+        if (!sync) return false;
+        f->dropUntilGap = false;
+    }
+
+    f->buf[f->idx++] = b;
+    if (f->idx < PAKET_LEN) return false;
+
+    f->idx = 0;
+    return true;
+}
+
+// framerPush() for ttys with enableLineErrorMarks(): \377 \377 is a 0xff byte, \377 \0 x is the byte x
+// received with a parity or framing error (\377 \0 \0 is a break). The paket with the error is dropped
+// at once, the next paket starts after the next gap.
+static inline bool framerPushMarked(struct PaketFramer *f, byte b, struct timeval now)
+{
+    if (f->markState == 0) {
+        if (b != 0xff) return framerPush(f, b, now);
+        f->markState = 1;
+        return false;
+    }
+    if (f->markState == 1) {
+        if (b == 0xff) {
+            f->markState = 0;
+            return framerPush(f, 0xff, now);
+        }
+        f->markState = 2;
+        return false;
+    }
+
+    f->markState    = 0;
+    f->lineErrors++;
+    f->idx          = 0;
+    f->dropUntilGap = true;
+    f->lastByteAt   = now;
+    return false;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+
+#endif  // VC830_H
@@ -0,0 +1,267 @@
+/*
+ * =============================================================================
+ *             (c) by Thomas Welsch / 2021 under the MIT License
+ * =============================================================================
+ *
+ * Header only C++17 API for the VC-830 decoder (vc830.h).
+ *
+ * Sources, filters and sinks are composed at compile time. All stages are templates
+ * which are called directly, so the compiler can inline the whole pipeline. There is
+ * no virtual dispatch and no allocation per sample:
+ *
+ *   vc830::Device dev("/dev/ttyUSB0");
+ *
+ *   auto pipeline = dev
+ *                 | vc830::filter([](const vc830::Sample &s) { return !s.overflow(); })
+ *                 | vc830::transform([](vc830::Sample &s) { s.data.siValue *= 1000; })
+ *                 | vc830::take(100)
+ *                 | vc830::sink([](const vc830::Sample &s) { std::cout << s.value() << "\n"; });
+ *   pipeline.run();
+ */
+
+#ifndef VC830_HPP
+#define VC830_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "vc830.h"
+
+namespace vc830 {
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// One decoded sample. The decoded data is kept in the C structure, the string fields
+// are only filled if requested from the source (FIELD_xxx).
+//
+struct Sample {
+    struct Vc830 data;
+
+    double   value() const { return data.siValue; }  // SI base unit
+    bool     overflow() const { return data.overflow; }
+    unsigned status() const { return data.status; }
+    bool     has(unsigned statusMask) const { return (data.status & statusMask) != 0; }  // STATUS_xxx
+    unsigned unit() const { return data.status & STATUS_UNITS; }
+
+    std::chrono::system_clock::time_point receivedAt() const
+    {
+        return std::chrono::system_clock::time_point(std::chrono::seconds(data.receivedAt.tv_sec) +
+                                                     std::chrono::microseconds(data.receivedAt.tv_usec));
+    }
+
+    const char *unitName() const
+    {
+        switch (unit()) {
+            case 0x80: return "V";
+            case 0x40: return "A";
+            case 0x20: return "Ω";
+            case 0x10: return "hFE";
+            case 0x08: return "Hz";
+            case 0x04: return "F";
+            case 0x02: return "°C";
+            case 0x01: return "°F";
+        }
+        return "";
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// RAII handle for a tty device or a capture file. Move only.
+//
+class Device {
+   public:
+    static constexpr bool isSource = true;
+
+    explicit Device(const char *path, unsigned fields = 0) : fields_(fields), fd_(openDevice(path))
+    {
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    Device(Device &&other) noexcept : fields_(other.fields_), fd_(std::exchange(other.fd_, -1)), errors_(other.errors_) {}
+
+    Device &operator=(Device &&other) noexcept
+    {
+        if (this != &other) {
+            close();
+            fields_ = other.fields_;
+            fd_     = std::exchange(other.fd_, -1);
+            errors_ = other.errors_;
+        }
+        return *this;
+    }
+
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+
+    ~Device() { close(); }
+
+    int  fd() const { return fd_; }
+    long errors() const { return errors_; }  // Pakets rejected by the decoder
+
+    // Reads the next valid sample. Returns false at the end of a capture file.
+    bool next(Sample &sample)
+    {
+        byte buf[BUFFER_LEN];
+
+        while (true) {
+            int ret = read14BytesPaket(fd_, buf);
+            if (ret == END_OF_CAPTURE_FILE) return false;
+            if (ret != 0) throw std::system_error(errno, std::generic_category(), "read14BytesPaket");
+
+            if (decodeFS9922Paket(buf, fields_, &sample.data) == 0) return true;
+            errors_++;
+        }
+    }
+
+   private:
+    void close()
+    {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    unsigned fields_;
+    int      fd_;
+    long     errors_ = 0;
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Stages. apply() gets the sample and the rest of the pipeline as next, it returns
+// false to stop the pipeline.
+//
+template <class Pred>
+struct Filter {
+    Pred pred;
+
+    template <class Next>
+    bool apply(Sample &s, Next &&next)
+    {
+        return pred(static_cast<const Sample &>(s)) ? next(s) : true;
+    }
+};
+
+template <class Fn>
+struct Transform {
+    Fn fn;
+
+    template <class Next>
+    bool apply(Sample &s, Next &&next)
+    {
+        fn(s);
+        return next(s);
+    }
+};
+
+struct Take {
+    long remaining;
+
+    template <class Next>
+    bool apply(Sample &s, Next &&next)
+    {
+        if (remaining <= 0) return false;
+        remaining--;
+        return next(s) && remaining > 0;
+    }
+};
+
+// Calls fn for each sample and passes it on, so sinks can also be used as taps.
+// If fn returns bool, false stops the pipeline.
+template <class Fn>
+struct Sink {
+    Fn fn;
+
+    template <class Next>
+    bool apply(Sample &s, Next &&next)
+    {
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn &, const Sample &>, bool>) {
+            if (!fn(static_cast<const Sample &>(s))) return false;
+        }
+        else {
+            fn(static_cast<const Sample &>(s));
+        }
+        return next(s);
+    }
+};
+
+template <class Pred>
+Filter<std::decay_t<Pred>> filter(Pred &&pred) { return {std::forward<Pred>(pred)}; }
+
+template <class Fn>
+Transform<std::decay_t<Fn>> transform(Fn &&fn) { return {std::forward<Fn>(fn)}; }
+
+inline Take take(long count) { return {count}; }
+
+template <class Fn>
+Sink<std::decay_t<Fn>> sink(Fn &&fn) { return {std::forward<Fn>(fn)}; }
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// A source with a compile time list of stages. Built with operator|.
+//
+template <class Source, class... Stages>
+class Pipeline {
+   public:
+    Pipeline(Source &source, std::tuple<Stages...> stages) : source_(source), stages_(std::move(stages)) {}
+
+    // Pushes one sample through the stages, returns false if a stage stopped the pipeline
+    bool push(Sample &s) { return pushFrom<0>(s); }
+
+    // Reads from the source until the end of data or a stage stops. Returns the number of samples read.
+    long run()
+    {
+        long   count = 0;
+        Sample s;
+        while (source_.next(s)) {
+            count++;
+            if (!push(s)) break;
+        }
+        return count;
+    }
+
+    template <class Stage>
+    Pipeline<Source, Stages..., Stage> append(Stage stage) &&
+    {
+        return {source_, std::tuple_cat(std::move(stages_), std::make_tuple(std::move(stage)))};
+    }
+
+   private:
+    template <std::size_t I>
+    bool pushFrom(Sample &s)
+    {
+        if constexpr (I == sizeof...(Stages)) {
+            return true;
+        }
+        else {
+            return std::get<I>(stages_).apply(s, [this](Sample &x) { return pushFrom<I + 1>(x); });
+        }
+    }
+
+    Source               &source_;
+    std::tuple<Stages...> stages_;
+};
+
+template <class Source, class Stage, std::enable_if_t<Source::isSource, int> = 0>
+Pipeline<Source, Stage> operator|(Source &source, Stage stage)
+{
+    return {source, std::make_tuple(std::move(stage))};
+}
+
+template <class Source, class... Stages, class Stage>
+Pipeline<Source, Stages..., Stage> operator|(Pipeline<Source, Stages...> &&pipeline, Stage stage)
+{
+    return std::move(pipeline).append(std::move(stage));
+}
+
+}  // namespace vc830
+
+#endif  // VC830_HPP
@@ -0,0 +1,319 @@
+/*
+ * =============================================================================
+ *             (c) by Thomas Welsch / 2021 under the MIT License
+ * =============================================================================
+ *
+ * C++20 coroutine interface for the VC-830 (Linux, epoll).
+ *
+ * One vc830::Reactor serves any number of meters and measurement tasks on one thread.
+ * The meters are read non blocking and framed with struct PaketFramer (vc830.h),
+ * waiting tasks are resumed when a sample arrives:
+ *
+ *   vc830::Task measure(vc830::AsyncMeter &meter)
+ *   {
+ *       auto first  = co_await meter.next_sample();
+ *       auto stable = co_await meter.wait_stable(0.01);   // 3 samples within 0.01 (SI unit)
+ *       if (stable) std::cout << stable->value() << "\n";
+ *   }
+ *
+ *   vc830::Reactor    reactor;
+ *   vc830::AsyncMeter meter(reactor, "/dev/ttyUSB0");
+ *   measure(meter);
+ *   reactor.run();
+ *
+ * The awaitables return std::optional<Sample>, it is empty at the end of data.
+ * Capture files can't be used with epoll, they are read in every loop of the reactor.
+ */
+
+#ifndef VC830_CORO_HPP
+#define VC830_CORO_HPP
+
+#include <sys/epoll.h>
+
+#include <cmath>
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+#include "vc830.hpp"
+
+namespace vc830 {
+
+class AsyncMeter;
+
+// --------------------------------------------------------------------------------------------------------------
+
+//
+// Fire and forget coroutine, starts immediately.
+//
+struct Task {
+    struct promise_type {
+        Task                get_return_object() { return {}; }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { std::terminate(); }
+    };
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+class Reactor {
+   public:
+    Reactor() : epfd_(epoll_create1(EPOLL_CLOEXEC))
+    {
+        if (epfd_ < 0) throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    ~Reactor() { ::close(epfd_); }
+
+    // Runs until stop() is called or all meters reached the end of data
+    void run()
+    {
+        stopped_ = false;
+        while (!stopped_ && meters_ > 0) step(100);
+    }
+
+    void stop() { stopped_ = true; }
+
+    // Waits up to timeoutMs for data and resumes the waiting tasks
+    inline void step(int timeoutMs);
+
+   private:
+    friend class AsyncMeter;
+
+    inline void add(AsyncMeter *meter);
+    inline void remove(AsyncMeter *meter);
+
+    int         epfd_;
+    int         meters_  = 0;
+    bool        stopped_ = false;
+    AsyncMeter *files_   = nullptr;  // Capture files, no epoll support
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+class AsyncMeter {
+   public:
+    AsyncMeter(Reactor &reactor, const char *path, unsigned fields = 0)
+        : reactor_(reactor), fields_(fields), fd_(openDevice(path))
+    {
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), path);
+        framerReset(&framer_);
+        reactor_.add(this);
+    }
+
+    AsyncMeter(const AsyncMeter &) = delete;
+    AsyncMeter &operator=(const AsyncMeter &) = delete;
+
+    // Waiting tasks are resumed with the end of data, their frames must not wait for a meter which is gone
+    ~AsyncMeter()
+    {
+        close();
+        deliver(nullptr);
+    }
+
+    long          errors() const { return errors_; }  // Pakets rejected by the decoder
+    bool          atEnd() const { return fd_ < 0; }
+    const Sample &last() const { return last_; }  // Last decoded sample
+
+    //
+    // Awaiters live in the coroutine frame and are linked into the meter while waiting.
+    //
+    struct Waiter {
+        AsyncMeter             *meter;
+        bool (*accept)(Waiter *self, const Sample &s);
+        std::optional<Sample>   result;
+        std::coroutine_handle<> handle;
+        Waiter                 *next = nullptr;
+
+        bool                  await_ready() const noexcept { return meter->atEnd(); }
+        void                  await_suspend(std::coroutine_handle<> h)
+        {
+            handle = h;
+            meter->wait(this);
+        }
+        std::optional<Sample> await_resume() { return std::move(result); }
+    };
+
+    struct NextSample : Waiter {
+        explicit NextSample(AsyncMeter *m) : Waiter{m, &NextSample::take, {}, {}} {}
+
+        static bool take(Waiter *self, const Sample &s)
+        {
+            self->result = s;
+            return true;
+        }
+    };
+
+    struct WaitStable : Waiter {
+        WaitStable(AsyncMeter *m, double tolerance, int samples)
+            : Waiter{m, &WaitStable::check, {}, {}}, tolerance(tolerance), samples(samples) {}
+
+        // Stable if 'samples' consecutive samples with the same unit are within tolerance of the first one
+        static bool check(Waiter *self, const Sample &s)
+        {
+            WaitStable *w = static_cast<WaitStable *>(self);
+
+            if (s.overflow()) {
+                w->count = 0;
+                return false;
+            }
+            if (w->count == 0 || s.unit() != w->unit || std::fabs(s.value() - w->reference) > w->tolerance) {
+                w->reference = s.value();
+                w->unit      = s.unit();
+                w->count     = 0;
+            }
+            if (++w->count < w->samples) return false;
+
+            self->result = s;
+            return true;
+        }
+
+        double   tolerance;
+        int      samples;
+        int      count     = 0;
+        double   reference = 0;
+        unsigned unit      = 0;
+    };
+
+    NextSample next_sample() { return NextSample(this); }
+    WaitStable wait_stable(double tolerance, int samples = 3) { return WaitStable(this, tolerance, samples); }
+
+   private:
+    friend class Reactor;
+
+    void wait(Waiter *w)
+    {
+        w->next  = waiters_;
+        waiters_ = w;
+    }
+
+    // Reads all available bytes. Returns false at the end of data.
+    bool onReadable()
+    {
+        byte buf[256];
+
+        while (fd_ >= 0) {
+            ssize_t l = ::read(fd_, buf, isFile_ ? PAKET_LEN : sizeof(buf));
+            if (l < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+            if (l <= 0) {
+                close();
+                deliver(nullptr);
+                return false;
+            }
+
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            for (ssize_t i = 0; i < l; i++) {
+                if (!framerPush(&framer_, buf[i], now)) continue;
+                if (decodeFS9922Paket(framer_.buf, fields_, &last_.data) != 0) {
+                    errors_++;
+                    continue;
+                }
+                deliver(&last_);
+            }
+            if (isFile_) return true;  // One paket per loop, so the other meters get their turn
+        }
+        return false;
+    }
+
+    // Resumes all waiters which accept the sample, or all waiters at the end of data (s == nullptr)
+    void deliver(const Sample *s)
+    {
+        Waiter  *ready = nullptr;
+        Waiter **pp    = &waiters_;
+
+        while (*pp) {
+            Waiter *w = *pp;
+            if (s == nullptr || w->accept(w, *s)) {
+                *pp     = w->next;
+                w->next = ready;
+                ready   = w;
+            }
+            else {
+                pp = &w->next;
+            }
+        }
+
+        // Resumed tasks may wait again, they are linked into waiters_ for the next sample
+        while (ready) {
+            Waiter *w = ready;
+            ready     = w->next;
+            w->handle.resume();
+        }
+    }
+
+    void close()
+    {
+        if (fd_ < 0) return;
+        reactor_.remove(this);
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    Reactor           &reactor_;
+    unsigned           fields_;
+    int                fd_;
+    bool               isFile_   = false;
+    AsyncMeter        *nextFile_ = nullptr;
+    struct PaketFramer framer_;
+    Sample             last_;
+    Waiter            *waiters_ = nullptr;
+    long               errors_  = 0;
+};
+
+// --------------------------------------------------------------------------------------------------------------
+
+inline void Reactor::add(AsyncMeter *meter)
+{
+    struct epoll_event ev = {};
+    ev.events             = EPOLLIN;
+    ev.data.ptr           = meter;
+
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, meter->fd_, &ev) != 0) {
+        if (errno != EPERM) throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        meter->isFile_   = true;
+        meter->nextFile_ = files_;
+        files_           = meter;
+    }
+    meters_++;
+}
+
+inline void Reactor::remove(AsyncMeter *meter)
+{
+    if (meter->isFile_) {
+        for (AsyncMeter **pp = &files_; *pp; pp = &(*pp)->nextFile_) {
+            if (*pp == meter) {
+                *pp = meter->nextFile_;
+                break;
+            }
+        }
+    }
+    else {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, meter->fd_, nullptr);
+    }
+    meters_--;
+}
+
+inline void Reactor::step(int timeoutMs)
+{
+    struct epoll_event events[64];
+
+    int n = epoll_wait(epfd_, events, 64, files_ ? 0 : timeoutMs);
+    if (n < 0 && errno != EINTR) throw std::system_error(errno, std::generic_category(), "epoll_wait");
+
+    for (int i = 0; i < n; i++) static_cast<AsyncMeter *>(events[i].data.ptr)->onReadable();
+
+    for (AsyncMeter *m = files_, *next; m; m = next) {
+        next = m->nextFile_;  // onReadable() removes the meter at the end of the file
+        m->onReadable();
+    }
+}
+
+}  // namespace vc830
+
+#endif  // VC830_CORO_HPP